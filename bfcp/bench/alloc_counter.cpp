@@ -0,0 +1,47 @@
+#include <bfcp/bench/alloc_counter.h>
+
+#include <new>
+#include <malloc.h>
+#include <stdlib.h>
+
+namespace
+{
+// NOTE: not muduo::AtomicInt64, operator new may be called
+// before the dynamic initialization of this file
+int64_t g_numAllocs = 0;
+int64_t g_liveBytes = 0;
+}
+
+void* operator new(size_t size)
+{
+  void *p = ::malloc(size == 0 ? 1 : size);
+  if (!p) throw std::bad_alloc();
+  __sync_fetch_and_add(&g_numAllocs, 1);
+  __sync_fetch_and_add(&g_liveBytes, static_cast<int64_t>(::malloc_usable_size(p)));
+  return p;
+}
+
+void operator delete(void *p) throw()
+{
+  if (!p) return;
+  __sync_fetch_and_sub(&g_liveBytes, static_cast<int64_t>(::malloc_usable_size(p)));
+  ::free(p);
+}
+
+namespace bfcp
+{
+namespace bench
+{
+
+uint64_t numAllocs()
+{
+  return static_cast<uint64_t>(__sync_fetch_and_add(&g_numAllocs, 0));
+}
+
+size_t liveBytes()
+{
+  return static_cast<size_t>(__sync_fetch_and_add(&g_liveBytes, 0));
+}
+
+} // namespace bench
+} // namespace bfcp
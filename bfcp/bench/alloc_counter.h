@@ -0,0 +1,22 @@
+#ifndef BFCP_BENCH_ALLOC_COUNTER_H
+#define BFCP_BENCH_ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bfcp
+{
+namespace bench
+{
+
+// counters of the global operator new and delete replaced in
+// alloc_counter.cpp, link it into the bench to count its allocations.
+// NOTE: the counters are shared by all threads
+uint64_t numAllocs();
+// heap bytes allocated by operator new and not deleted yet
+size_t liveBytes();
+
+} // namespace bench
+} // namespace bfcp
+
+#endif // BFCP_BENCH_ALLOC_COUNTER_H
@@ -0,0 +1,137 @@
+// throughput of the conferences run by ThreadPool at different drain budgets,
+// and how long a task waits to run, which grows with the budget 
+// as a worker stays longer on one conference.
+// Each producer (a connection loop) sends bursts of requests 
+// to random conferences.
+// usage: drain_budget_bench [workers [producers [conferences [tasksPerProducer [burst]]]]]
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+
+#include <bfcp/server/thread_pool.h>
+
+using muduo::Timestamp;
+using muduo::timeDifference;
+using bfcp::ThreadPool;
+
+namespace
+{
+
+std::atomic<long> g_done(0);
+std::atomic<int64_t> g_maxWaitUs(0);
+
+// a small task, like handling a decoded request
+struct ConferenceTask
+{
+  ConferenceTask() : queuedTime(Timestamp::now()) {}
+
+  void operator()() const
+  {
+    int64_t waitUs = Timestamp::now().microSecondsSinceEpoch() 
+      - queuedTime.microSecondsSinceEpoch();
+    int64_t maxWaitUs = g_maxWaitUs.load(std::memory_order_relaxed);
+    while (waitUs > maxWaitUs && 
+           !g_maxWaitUs.compare_exchange_weak(maxWaitUs, waitUs))
+    {
+    }
+    for (volatile int i = 0; i < 50; ++i) {}
+    g_done.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Timestamp queuedTime;
+};
+
+void produce(ThreadPool *pool, int producerIndex, 
+             size_t numConferences, long numTasks, long burst)
+{
+  unsigned seed = producerIndex * 7919 + 1;
+  for (long i = 0; i < numTasks; i += burst)
+  {
+    seed = seed * 1103515245 + 12345;
+    uint32_t conferenceID = static_cast<uint32_t>((seed >> 8) % numConferences);
+    for (long j = 0; j < burst && i + j < numTasks; ++j)
+    {
+      pool->run(conferenceID, ConferenceTask(), ThreadPool::kNormalPriority);
+    }
+  }
+}
+
+void bench(size_t drainTasks, double drainTime, 
+           int numWorkers, int numProducers, 
+           size_t numConferences, long numTasks, long burst)
+{
+  g_done = 0;
+  g_maxWaitUs = 0;
+
+  ThreadPool pool("DrainBudgetBench");
+  pool.setDrainBudget(drainTasks, drainTime);
+  for (size_t i = 0; i < numConferences; ++i)
+  {
+    pool.createQueue(static_cast<uint32_t>(i), 0);
+  }
+  pool.start(numWorkers);
+
+  Timestamp start(Timestamp::now());
+  boost::ptr_vector<muduo::Thread> producers;
+  for (int i = 0; i < numProducers; ++i)
+  {
+    producers.push_back(new muduo::Thread(
+      boost::bind(&produce, &pool, i, numConferences, numTasks, burst)));
+    producers.back().start();
+  }
+  for (auto &producer : producers)
+  {
+    producer.join();
+  }
+  long total = numTasks * numProducers;
+  while (g_done.load() < total)
+  {
+    sched_yield();
+  }
+  double elapsed = timeDifference(Timestamp::now(), start);
+
+  char timeBudget[32] = "no time limit";
+  if (drainTime >= 0.0)
+  {
+    snprintf(timeBudget, sizeof timeBudget, "%.0f us", drainTime * 1e6);
+  }
+  printf("budget %5zu tasks, %-13s: %6.0f ktasks/s, max wait %8.2f ms\n",
+         drainTasks, timeBudget,
+         static_cast<double>(total) / elapsed / 1000.0,
+         static_cast<double>(g_maxWaitUs.load()) / 1000.0);
+  pool.stop();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  int numWorkers = argc > 1 ? atoi(argv[1]) : 4;
+  int numProducers = argc > 2 ? atoi(argv[2]) : 2;
+  size_t numConferences = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 64;
+  long numTasks = argc > 4 ? atol(argv[4]) : 500000;
+  long burst = argc > 5 ? std::max(1L, atol(argv[5])) : 100;
+
+  printf("workers=%d producers=%d conferences=%zu tasks=%ld burst=%ld\n",
+         numWorkers, numProducers, numConferences, 
+         numTasks * numProducers, burst);
+  const size_t budgets[] = { 1, 4, ThreadPool::kDefaultDrainTasks, 64, 1024 };
+  for (size_t drainTasks : budgets)
+  {
+    bench(drainTasks, -1.0, 
+      numWorkers, numProducers, numConferences, numTasks, burst);
+  }
+  // the time budget cuts the long drains
+  bench(1024, 0.00005, 
+    numWorkers, numProducers, numConferences, numTasks, burst);
+  return 0;
+}
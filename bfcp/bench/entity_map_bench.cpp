@@ -0,0 +1,128 @@
+// insert/find/erase cost of EntityMap against the std::map
+// which BfcpConnection::ctrans_ used before, 
+// with 1k, 10k and 100k in-flight transactions
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <muduo/base/Timestamp.h>
+
+#include <bfcp/common/bfcp_entity_map.h>
+
+using muduo::Timestamp;
+using muduo::timeDifference;
+
+typedef boost::shared_ptr<int> ValuePtr;
+typedef std::vector<bfcp_entity> EntityList;
+
+const size_t kOpsPerRound = 2000000;
+
+// n distinct entities of 100 conferences and 500 users per conference
+EntityList makeEntities(size_t n)
+{
+  EntityList entities(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    entities[i].conferenceID = static_cast<uint32_t>(1 + i % 100);
+    entities[i].userID = static_cast<uint16_t>(1 + (i / 100) % 500);
+    entities[i].transactionID = static_cast<uint16_t>(1 + i / 50000);
+  }
+  return entities;
+}
+
+struct StdMap
+{
+  static const char* name() { return "std::map"; }
+
+  bool insert(const bfcp_entity &entity, const ValuePtr &value)
+  { return map.insert(std::make_pair(entity, value)).second; }
+
+  ValuePtr* find(const bfcp_entity &entity)
+  {
+    auto it = map.find(entity);
+    return it == map.end() ? nullptr : &(*it).second;
+  }
+
+  bool erase(const bfcp_entity &entity) { return map.erase(entity) == 1; }
+
+  std::map<bfcp_entity, ValuePtr> map;
+};
+
+struct FlatMap
+{
+  static const char* name() { return "EntityMap"; }
+
+  bool insert(const bfcp_entity &entity, const ValuePtr &value)
+  { return map.insert(entity, value); }
+
+  ValuePtr* find(const bfcp_entity &entity) { return map.find(entity); }
+
+  bool erase(const bfcp_entity &entity) { return map.erase(entity); }
+
+  bfcp::EntityMap<ValuePtr> map;
+};
+
+template <typename Map>
+void bench(const EntityList &entities, const EntityList &shuffled)
+{
+  const ValuePtr value(new int(0));
+  size_t rounds = std::max<size_t>(1, kOpsPerRound / entities.size());
+  double insertTime = 0.0;
+  double findTime = 0.0;
+  double eraseTime = 0.0;
+  size_t found = 0;
+  for (size_t round = 0; round < rounds; ++round)
+  {
+    Map map;
+    Timestamp start(Timestamp::now());
+    for (const auto &entity : entities)
+    {
+      map.insert(entity, value);
+    }
+    Timestamp inserted(Timestamp::now());
+    for (const auto &entity : shuffled)
+    {
+      if (map.find(entity)) ++found;
+    }
+    Timestamp searched(Timestamp::now());
+    for (const auto &entity : shuffled)
+    {
+      map.erase(entity);
+    }
+    Timestamp erased(Timestamp::now());
+    insertTime += timeDifference(inserted, start);
+    findTime += timeDifference(searched, inserted);
+    eraseTime += timeDifference(erased, searched);
+  }
+
+  if (found != rounds * entities.size())
+  {
+    printf("%s lost entities: %zu of %zu found\n",
+           Map::name(), found, rounds * entities.size());
+    abort();
+  }
+
+  double ops = static_cast<double>(rounds * entities.size()) / 1e9;
+  printf("%-10s n=%-7zu insert %7.1f ns/op, find %7.1f ns/op, erase %7.1f ns/op\n",
+         Map::name(), entities.size(),
+         insertTime / ops, findTime / ops, eraseTime / ops);
+}
+
+int main()
+{
+  const size_t sizes[] = { 1000, 10000, 100000 };
+  for (size_t n : sizes)
+  {
+    EntityList entities = makeEntities(n);
+    EntityList shuffled(entities);
+    std::random_shuffle(shuffled.begin(), shuffled.end());
+    bench<StdMap>(entities, shuffled);
+    bench<FlatMap>(entities, shuffled);
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// lookup cost and heap bytes of the user table of a conference,
+// FlatMap against the std::map which Conference::users_ used before,
+// with 10, 1,000 and 65,535 users
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <muduo/base/Timestamp.h>
+
+#include <bfcp/common/bfcp_flat_map.h>
+#include <bfcp/bench/alloc_counter.h>
+
+using muduo::Timestamp;
+using muduo::timeDifference;
+using bfcp::bench::liveBytes;
+
+typedef boost::shared_ptr<int> UserPtr;
+typedef std::vector<uint16_t> UserIDList;
+
+const size_t kLookups = 4000000;
+
+template <typename Map>
+void bench(const char *name, const UserIDList &userIDs, const UserPtr &user)
+{
+  size_t bytesBefore = liveBytes();
+  Map users;
+  for (uint16_t userID : userIDs)
+  {
+    users.insert(std::make_pair(userID, user));
+  }
+  size_t bytes = liveBytes() - bytesBefore;
+
+  UserIDList lookups(kLookups);
+  for (size_t i = 0; i < kLookups; ++i)
+  {
+    lookups[i] = userIDs[static_cast<size_t>(rand()) % userIDs.size()];
+  }
+
+  size_t found = 0;
+  Timestamp start(Timestamp::now());
+  for (uint16_t userID : lookups)
+  {
+    if (users.find(userID) != users.end()) ++found;
+  }
+  double elapsed = timeDifference(Timestamp::now(), start);
+  if (found != kLookups)
+  {
+    printf("%s lost users: %zu of %zu found\n", name, found, kLookups);
+    abort();
+  }
+
+  printf("%-8s users=%-6zu find %6.1f ns, %9zu heap bytes\n",
+         name, userIDs.size(), elapsed * 1e9 / kLookups, bytes);
+}
+
+int main()
+{
+  const UserPtr user(new int(0));
+  const size_t sizes[] = { 10, 1000, 65535 };
+  for (size_t n : sizes)
+  {
+    // the users join in random order
+    UserIDList userIDs(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      userIDs[i] = static_cast<uint16_t>(i + 1);
+    }
+    std::random_shuffle(userIDs.begin(), userIDs.end());
+
+    bench<std::map<uint16_t, UserPtr> >("std::map", userIDs, user);
+    bench<bfcp::FlatMap<uint16_t, UserPtr> >("FlatMap", userIDs, user);
+  }
+  return 0;
+}
@@ -0,0 +1,223 @@
+#ifndef BFCP_BENCH_LOCKED_THREAD_POOL_H
+#define BFCP_BENCH_LOCKED_THREAD_POOL_H
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <stdio.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <muduo/base/Condition.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Types.h>
+
+namespace bfcp
+{
+namespace bench
+{
+
+// The ThreadPool before the work-stealing scheduler, kept as the baseline
+// of the benchmarks: every ready task queue goes through one global deque
+// guarded by one mutex and condition, each task queue has its own mutex,
+// and a pickup runs all the high priority tasks or one normal priority task.
+// NOTE: queue size limits and releaseQueue are left out
+class LockedThreadPool : boost::noncopyable
+{
+public:
+  typedef boost::function<void ()> Task;
+
+  enum Priority
+  {
+    kNormalPriority = 1,
+    kHighPriority = 2,
+  };
+
+  explicit LockedThreadPool(const muduo::string &name = muduo::string("LockedThreadPool"))
+      : notEmpty_(mutex_),
+        name_(name),
+        running_(false)
+  {}
+
+  ~LockedThreadPool()
+  {
+    if (running_)
+    {
+      stop();
+    }
+  }
+
+  int createQueue(uint32_t queueID, size_t maxQueueSize)
+  {
+    if (queueMap_.find(queueID) != queueMap_.end()) return -1;
+    queueMap_[queueID] = boost::make_shared<TaskQueue>();
+    return 0;
+  }
+
+  void start(int numThreads)
+  {
+    running_ = true;
+    threads_.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+      char id[32];
+      snprintf(id, sizeof id, "%d", i + 1);
+      threads_.push_back(new muduo::Thread(
+        boost::bind(&LockedThreadPool::runInThread, this), name_ + id));
+      threads_[i].start();
+    }
+  }
+
+  void stop()
+  {
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      running_ = false;
+      notEmpty_.notifyAll();
+    }
+    for (auto &thread : threads_)
+    {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+  // NOTE: the queue map isn't locked, create the queues before running
+  int run(uint32_t queueID, Task &&task, Priority priority)
+  {
+    auto it = queueMap_.find(queueID);
+    if (it == queueMap_.end())
+    {
+      return -1;
+    }
+    (*it).second->put(std::move(task), priority);
+    put((*it).second);
+    return 0;
+  }
+
+private:
+  class TaskQueue : boost::noncopyable
+  {
+  public:
+    typedef std::vector<Task> Tasks;
+
+    TaskQueue() : isInGlobal(false), isProcessing(false) {}
+
+    void put(Task &&task, Priority priority)
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      if (priority == kHighPriority)
+      {
+        highPriorityTasks_.push_back(std::move(task));
+      }
+      else
+      {
+        normalPriorityTasks_.push_back(std::move(task));
+      }
+    }
+
+    Tasks take()
+    {
+      Tasks tasks;
+      muduo::MutexLockGuard lock(mutex_);
+      if (!highPriorityTasks_.empty())
+      {
+        tasks.swap(highPriorityTasks_);
+      }
+      else if (!normalPriorityTasks_.empty())
+      {
+        tasks.push_back(std::move(normalPriorityTasks_.front()));
+        normalPriorityTasks_.pop_front();
+      }
+      return tasks;
+    }
+
+    bool empty()
+    {
+      muduo::MutexLockGuard lock(mutex_);
+      return highPriorityTasks_.empty() && normalPriorityTasks_.empty();
+    }
+
+    // guarded by the mutex of the pool
+    bool isInGlobal;
+    bool isProcessing;
+
+  private:
+    muduo::MutexLock mutex_;
+    Tasks highPriorityTasks_;
+    std::deque<Task> normalPriorityTasks_;
+  };
+
+  typedef boost::shared_ptr<TaskQueue> TaskQueuePtr;
+
+  void runInThread()
+  {
+    while (running_)
+    {
+      TaskQueuePtr taskQueue = take();
+      if (taskQueue)
+      {
+        TaskQueue::Tasks tasks = taskQueue->take();
+        for (auto &task : tasks)
+        {
+          task();
+        }
+        {
+          muduo::MutexLockGuard lock(mutex_);
+          taskQueue->isProcessing = false;
+        }
+        put(taskQueue);
+      }
+    }
+  }
+
+  TaskQueuePtr take()
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    while (globalQueue_.empty() && running_)
+    {
+      notEmpty_.wait();
+    }
+
+    TaskQueuePtr taskQueue;
+    if (!globalQueue_.empty())
+    {
+      taskQueue = globalQueue_.front();
+      taskQueue->isProcessing = true;
+      taskQueue->isInGlobal = false;
+      globalQueue_.pop_front();
+    }
+    return taskQueue;
+  }
+
+  void put(const TaskQueuePtr &taskQueue)
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (taskQueue->isProcessing || taskQueue->isInGlobal || taskQueue->empty())
+    {
+      return;
+    }
+    taskQueue->isInGlobal = true;
+    globalQueue_.push_back(taskQueue);
+    notEmpty_.notify();
+  }
+
+  muduo::MutexLock mutex_;
+  muduo::Condition notEmpty_;
+  muduo::string name_;
+  boost::ptr_vector<muduo::Thread> threads_;
+  std::map<uint32_t, TaskQueuePtr> queueMap_;
+  std::deque<TaskQueuePtr> globalQueue_;
+  bool running_;
+};
+
+} // namespace bench
+} // namespace bfcp
+
+#endif // BFCP_BENCH_LOCKED_THREAD_POOL_H
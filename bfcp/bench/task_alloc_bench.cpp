@@ -0,0 +1,232 @@
+// heap allocations per task on the way from a connection loop to a conference,
+// bfcp::Task against the boost::function which ThreadPool::Task was before,
+// and through ThreadPool::run with the typed tasks and the binds.
+// The tasks are shaped like NewRequestTask and ResponseTask of base_server.cpp,
+// the inline ones must not allocate, otherwise the bench aborts.
+// usage: task_alloc_bench [workers [tasks]]
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <muduo/base/Timestamp.h>
+
+#include <bfcp/server/task.h>
+#include <bfcp/server/thread_pool.h>
+#include <bfcp/bench/alloc_counter.h>
+
+using muduo::Timestamp;
+using muduo::timeDifference;
+using bfcp::Task;
+using bfcp::ThreadPool;
+using bfcp::bench::numAllocs;
+
+namespace
+{
+
+// NOTE: the same sizes as bfcp_prim, ResponseError and BfcpMsgPtr,
+// without linking libre
+enum Primitive { kFloorStatus = 9 };
+enum Error { kNoError = 0 };
+typedef boost::shared_ptr<int> MsgPtr;
+
+std::atomic<long> g_done(0);
+
+class Conference
+{
+public:
+  void onNewRequest(const MsgPtr &msg)
+  { g_done.fetch_add(1, std::memory_order_relaxed); }
+
+  void onResponse(Primitive expectedPrimitive, uint16_t userID,
+                  uint32_t notificationID, Error err, const MsgPtr &msg)
+  { g_done.fetch_add(1, std::memory_order_relaxed); }
+};
+typedef boost::shared_ptr<Conference> ConferencePtr;
+
+class NewRequestTask
+{
+public:
+  NewRequestTask(const ConferencePtr &conference, const MsgPtr &msg)
+      : conference_(conference), msg_(msg)
+  {}
+
+  void operator()() { conference_->onNewRequest(msg_); }
+
+private:
+  ConferencePtr conference_;
+  MsgPtr msg_;
+};
+
+class ResponseTask
+{
+public:
+  ResponseTask(const ConferencePtr &conference, const MsgPtr &msg)
+      : conference_(conference),
+        msg_(msg),
+        notificationID_(3),
+        expectedPrimitive_(kFloorStatus),
+        err_(kNoError),
+        userID_(2)
+  {}
+
+  void operator()()
+  {
+    conference_->onResponse(
+      expectedPrimitive_, userID_, notificationID_, err_, msg_);
+  }
+
+private:
+  ConferencePtr conference_;
+  MsgPtr msg_;
+  uint32_t notificationID_;
+  Primitive expectedPrimitive_;
+  Error err_;
+  uint16_t userID_;
+};
+
+// a task larger than Task::kInlineSize, moved to the heap
+struct LargeTask
+{
+  void operator()() { g_done.fetch_add(1, std::memory_order_relaxed); }
+  char padding[Task::kInlineSize + 8];
+};
+
+void countAllocs(const char *name, long numTasks, bool inlined,
+                 const boost::function<void ()> &makeAndRun)
+{
+  uint64_t allocsBefore = numAllocs();
+  for (long i = 0; i < numTasks; ++i)
+  {
+    makeAndRun();
+  }
+  double allocsPerTask =
+    static_cast<double>(numAllocs() - allocsBefore) / static_cast<double>(numTasks);
+  printf("%-40s %6.3f allocs/task\n", name, allocsPerTask);
+  if (inlined && allocsPerTask != 0.0)
+  {
+    fprintf(stderr, "%s allocates\n", name);
+    abort();
+  }
+}
+
+template <typename F>
+void runAsTask(const F &f)
+{
+  Task task(f);
+  Task moved(std::move(task));
+  moved();
+}
+
+template <typename F>
+void runAsFunction(const F &f)
+{
+  boost::function<void ()> function(f);
+  boost::function<void ()> copied(function);
+  copied();
+}
+
+// the producer waits when more than maxDepth tasks are queued,
+// like a connection loop paced by the network
+void runInPool(ThreadPool *pool, long numTasks, bool typed,
+               const ConferencePtr &conference, const MsgPtr &msg)
+{
+  static const long kMaxDepth = 16;
+  long target = g_done.load() + numTasks;
+  for (long i = 0; i < numTasks; ++i)
+  {
+    if (typed)
+    {
+      if (i & 1)
+        pool->run(1, NewRequestTask(conference, msg), ThreadPool::kNormalPriority);
+      else
+        pool->run(1, ResponseTask(conference, msg), ThreadPool::kHighPriority);
+    }
+    else
+    {
+      if (i & 1)
+        pool->run(1, boost::bind(&Conference::onNewRequest, conference, msg),
+                  ThreadPool::kNormalPriority);
+      else
+        pool->run(1, boost::bind(&Conference::onResponse, conference, kFloorStatus,
+                                 static_cast<uint16_t>(2), 3u, kNoError, msg),
+                  ThreadPool::kHighPriority);
+    }
+    while (g_done.load() < target - numTasks + i - kMaxDepth)
+    {
+      sched_yield();
+    }
+  }
+  while (g_done.load() < target)
+  {
+    sched_yield();
+  }
+}
+
+void benchPool(const char *name, ThreadPool *pool, long numTasks, bool typed,
+               const ConferencePtr &conference, const MsgPtr &msg)
+{
+  runInPool(pool, 1000, typed, conference, msg); // warm up the free nodes
+  uint64_t allocsBefore = numAllocs();
+  Timestamp start(Timestamp::now());
+  runInPool(pool, numTasks, typed, conference, msg);
+  double elapsed = timeDifference(Timestamp::now(), start);
+  uint64_t allocs = numAllocs() - allocsBefore;
+  printf("%-40s %6.3f allocs/task (%llu), %6.0f ktasks/s\n", name,
+         static_cast<double>(allocs) / static_cast<double>(numTasks),
+         static_cast<unsigned long long>(allocs),
+         static_cast<double>(numTasks) / elapsed / 1000.0);
+  // NOTE: MpscQueue allocates a node when its free nodes are used up
+  // or being taken by another producer, rare but seen with several workers,
+  // so allow 1 in 10000
+  if (typed && allocs * 10000 > static_cast<uint64_t>(numTasks))
+  {
+    fprintf(stderr, "%s allocates\n", name);
+    abort();
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  int numWorkers = argc > 1 ? atoi(argv[1]) : 1;
+  long numTasks = argc > 2 ? atol(argv[2]) : 200000;
+
+  ConferencePtr conference(boost::make_shared<Conference>());
+  MsgPtr msg(boost::make_shared<int>(0));
+
+  printf("sizeof: NewRequestTask %zu, ResponseTask %zu, bind of onResponse %zu,"
+         " Task::kInlineSize %zu\n",
+         sizeof(NewRequestTask), sizeof(ResponseTask),
+         sizeof(boost::bind(&Conference::onResponse, conference, kFloorStatus,
+                            static_cast<uint16_t>(2), 3u, kNoError, msg)),
+         Task::kInlineSize);
+
+  countAllocs("Task of NewRequestTask", numTasks, true,
+    boost::bind(&runAsTask<NewRequestTask>, NewRequestTask(conference, msg)));
+  countAllocs("Task of ResponseTask", numTasks, true,
+    boost::bind(&runAsTask<ResponseTask>, ResponseTask(conference, msg)));
+  countAllocs("Task of LargeTask", numTasks, false,
+    boost::bind(&runAsTask<LargeTask>, LargeTask()));
+  countAllocs("boost::function of NewRequestTask", numTasks, false,
+    boost::bind(&runAsFunction<NewRequestTask>, NewRequestTask(conference, msg)));
+  countAllocs("boost::function of ResponseTask", numTasks, false,
+    boost::bind(&runAsFunction<ResponseTask>, ResponseTask(conference, msg)));
+
+  printf("workers=%d tasks=%ld\n", numWorkers, numTasks);
+  ThreadPool pool("TaskAllocBench");
+  pool.createQueue(1, 0);
+  pool.start(numWorkers);
+  benchPool("ThreadPool::run of the typed tasks", &pool, numTasks, true,
+            conference, msg);
+  benchPool("ThreadPool::run of the binds", &pool, numTasks, false,
+            conference, msg);
+  pool.stop();
+  return 0;
+}
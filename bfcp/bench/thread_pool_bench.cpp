@@ -0,0 +1,149 @@
+// throughput of ThreadPool against the global-lock pool it replaced,
+// producers (the connection loops) run tasks on random task queues 
+// (the conferences), 1/16 of the tasks are high priority.
+// usage: thread_pool_bench [workers [producers [queues [tasksPerProducer]]]]
+
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
+
+#include <bfcp/server/thread_pool.h>
+#include <bfcp/bench/locked_thread_pool.h>
+
+using muduo::Timestamp;
+using muduo::timeDifference;
+using bfcp::ThreadPool;
+using bfcp::bench::LockedThreadPool;
+
+namespace
+{
+
+struct Conference
+{
+  Conference() : running(0), numTasks(0) {}
+
+  std::atomic<int> running;
+  long numTasks;
+  char pad[64];
+};
+
+std::vector<Conference> g_conferences;
+std::atomic<long> g_done(0);
+std::atomic<int> g_violations(0);
+
+// a small task, like handling a decoded request
+struct ConferenceTask
+{
+  explicit ConferenceTask(size_t i) : index(i) {}
+
+  void operator()() const
+  {
+    Conference &conference = g_conferences[index];
+    // the tasks of a queue must never run concurrently
+    if (conference.running.fetch_add(1) != 0) ++g_violations;
+    ++conference.numTasks;
+    for (volatile int i = 0; i < 50; ++i) {}
+    conference.running.fetch_sub(1);
+    g_done.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t index;
+};
+
+template <typename Pool>
+void produce(Pool *pool, int producerIndex, size_t numQueues, long numTasks)
+{
+  unsigned seed = producerIndex * 7919 + 1;
+  for (long i = 0; i < numTasks; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    size_t index = (seed >> 8) % numQueues;
+    typename Pool::Priority priority = 
+      i % 16 == 0 ? Pool::kHighPriority : Pool::kNormalPriority;
+    pool->run(static_cast<uint32_t>(index), ConferenceTask(index), priority);
+  }
+}
+
+void printStats(const ThreadPool &pool)
+{
+  ThreadPool::Stats stats = pool.getStats();
+  printf("  steals=%llu parks=%llu unparks=%llu\n",
+         static_cast<unsigned long long>(stats.steals),
+         static_cast<unsigned long long>(stats.parks),
+         static_cast<unsigned long long>(stats.unparks));
+}
+
+void printStats(const LockedThreadPool &pool)
+{
+}
+
+template <typename Pool>
+void bench(const char *name, 
+           int numWorkers, int numProducers, size_t numQueues, long numTasks)
+{
+  g_conferences = std::vector<Conference>(numQueues);
+  g_done = 0;
+  g_violations = 0;
+
+  Pool pool(name);
+  for (size_t i = 0; i < numQueues; ++i)
+  {
+    pool.createQueue(static_cast<uint32_t>(i), 0);
+  }
+  pool.start(numWorkers);
+
+  Timestamp start(Timestamp::now());
+  boost::ptr_vector<muduo::Thread> producers;
+  for (int i = 0; i < numProducers; ++i)
+  {
+    producers.push_back(new muduo::Thread(
+      boost::bind(&produce<Pool>, &pool, i, numQueues, numTasks)));
+    producers.back().start();
+  }
+  for (auto &producer : producers)
+  {
+    producer.join();
+  }
+  long total = numTasks * numProducers;
+  while (g_done.load() < total)
+  {
+    sched_yield();
+  }
+  double elapsed = timeDifference(Timestamp::now(), start);
+
+  long sum = 0;
+  for (const auto &conference : g_conferences)
+  {
+    sum += conference.numTasks;
+  }
+  printf("%-16s workers=%d producers=%d queues=%zu: %.0f ktasks/s, "
+         "violations=%d, lost=%ld\n",
+         name, numWorkers, numProducers, numQueues, 
+         static_cast<double>(total) / elapsed / 1000.0,
+         g_violations.load(), total - sum);
+  printStats(pool);
+  pool.stop();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  int numWorkers = argc > 1 ? atoi(argv[1]) : 16;
+  int numProducers = argc > 2 ? atoi(argv[2]) : 4;
+  size_t numQueues = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 256;
+  long numTasks = argc > 4 ? atol(argv[4]) : 250000;
+
+  bench<LockedThreadPool>("LockedThreadPool", 
+    numWorkers, numProducers, numQueues, numTasks);
+  bench<ThreadPool>("ThreadPool", 
+    numWorkers, numProducers, numQueues, numTasks);
+  return 0;
+}
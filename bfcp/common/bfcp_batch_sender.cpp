@@ -0,0 +1,28 @@
+#include <bfcp/common/bfcp_batch_sender.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/UdpSocket.h>
+
+using muduo::net::EventLoop;
+using muduo::net::InetAddress;
+using muduo::net::UdpSocketPtr;
+
+namespace bfcp
+{
+
+BatchSender::BatchSender(EventLoop *loop, const UdpSocketPtr &socket)
+    : loop_(CHECK_NOTNULL(loop)),
+      socket_(socket)
+{
+}
+
+void BatchSender::send(const InetAddress &dst, mbuf_t *buf)
+{
+  loop_->assertInLoopThread();
+  socket_->send(dst, buf->buf, static_cast<int>(buf->end));
+  ++stats_.syscalls;
+  ++stats_.datagrams;
+  stats_.maxDatagramsPerSyscall = 1;
+}
+
+} // namespace bfcp
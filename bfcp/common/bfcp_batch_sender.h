@@ -0,0 +1,51 @@
+#ifndef BFCP_BATCH_SENDER_H
+#define BFCP_BATCH_SENDER_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <muduo/net/Callbacks.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+
+#include <bfcp/common/bfcp_ex.h>
+
+namespace bfcp
+{
+
+// Send the datagrams of a UdpSocket, each one by UdpSocket::send at once.
+// FIXME: collect the datagrams of one loop iteration and send them 
+// by one sendmmsg (linux only), it needs the native fd of the UdpSocket 
+// which muduo-x doesn't expose yet.
+class BatchSender : boost::noncopyable
+{
+public:
+  typedef struct Stats
+  {
+    Stats() : syscalls(0), datagrams(0), maxDatagramsPerSyscall(0) {}
+
+    uint64_t syscalls;
+    uint64_t datagrams;
+    size_t maxDatagramsPerSyscall;
+  } Stats;
+
+  BatchSender(muduo::net::EventLoop *loop,
+              const muduo::net::UdpSocketPtr &socket);
+
+  // NOTE: should be called in loop thread
+  void send(const muduo::net::InetAddress &dst, mbuf_t *buf);
+
+  // NOTE: should be called in loop thread
+  const Stats& getStats() const { return stats_; }
+
+private:
+  muduo::net::EventLoop *loop_;
+  muduo::net::UdpSocketPtr socket_;
+  Stats stats_;
+};
+
+typedef boost::shared_ptr<BatchSender> BatchSenderPtr;
+
+} // namespace bfcp
+
+#endif // BFCP_BATCH_SENDER_H
@@ -2,6 +2,7 @@
 #define BFCP_BUF_POOL_H
 
 #include <boost/noncopyable.hpp>
+#include <boost/make_shared.hpp>
 #include <muduo/base/Timestamp.h>
 #include <muduo/base/BlockingQueue.h>
 #include <muduo/base/Singleton.h>
@@ -53,6 +54,20 @@ public:
   }
 
 
+  // return nullptr instead of waiting if all buf nodes are used
+  BfcpBufNodePtr tryGetFreeBufNode()
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (bufQueue_.empty())
+    {
+      if (usedBufCount_ >= maxBufCount_) 
+        return nullptr;
+      ++usedBufCount_;
+      return boost::make_shared<BfcpBufNode>();
+    }
+    return bufQueue_.take();
+  }
+
   void releaseBufNode(BfcpBufNodePtr &bufNode)
   {
     bufQueue_.put(bufNode);
@@ -42,8 +42,11 @@ namespace bfcp
 BfcpConnection::BfcpConnection(EventLoop *loop, const UdpSocketPtr &socket)
     : loop_(CHECK_NOTNULL(loop)),
       socket_(socket),
-      cachedReplys_(BFCP_T2_SEC),
-      currentCachedReplys_(0),
+      sender_(boost::make_shared<BatchSender>(loop, socket)),
+      mbufPool_(boost::make_shared<MBufPool>()),
+      timingWheel_(BFCP_TICK_MSEC / 1000.0),
+      retransmitTimerStarted_(false),
+      cachedReplys_(BFCP_T2_SEC, DEFAULT_MAX_CACHED_REPLY_BYTES),
       cachedFragments_(BFCP_T2_SEC),
       nextTid_(1)
 {
@@ -52,8 +55,6 @@ BfcpConnection::BfcpConnection(EventLoop *loop, const UdpSocketPtr &socket)
   responseTimer_ = 
     loop_->runEvery(1.0, boost::bind(&BfcpConnection::onTimer, this));
   timerNeedStop_ = true;
-  cachedReplys_.resize(BFCP_T2_SEC);
-  cachedFragments_.resize(BFCP_T2_SEC);
 }
 
 BfcpConnection::~BfcpConnection()
@@ -69,18 +70,32 @@ void BfcpConnection::stopCacheTimer()
     loop_->cancel(responseTimer_);
     timerNeedStop_ = false;
   }
+  if (retransmitTimerStarted_)
+  {
+    loop_->cancel(retransmitTimer_);
+    retransmitTimerStarted_ = false;
+  }
 }
 
 void BfcpConnection::onTimer()
 {
-  currentCachedReplys_ -= cachedReplys_.front().size();
-  cachedReplys_.push_back(ReplyBucket());
+  cachedReplys_.tick();
   
-  if (!cachedFragments_.front().empty())
+  if (cachedFragments_.tick() > 0)
   {
     LOG_WARN << "Some cached fragments was cleared";
   }
-  cachedFragments_.push_back(FragmentBucket());
+}
+
+void BfcpConnection::onRetransmitTick()
+{
+  timingWheel_.tick();
+  // stop ticking when idle, restarted by startNewClientTransaction
+  if (timingWheel_.empty())
+  {
+    loop_->cancel(retransmitTimer_);
+    retransmitTimerStarted_ = false;
+  }
 }
 
 void BfcpConnection::onMessage(muduo::net::Buffer *buf, 
@@ -133,32 +148,29 @@ bool BfcpConnection::tryHandleFragmentMessage(const BfcpMsgPtr &msg,
   entry.prim = msg->primitive();
   entry.entity = msg->getEntity();
 
-  for (auto &bucket : cachedFragments_)
+  BfcpMsgPtr *cachedMsg = cachedFragments_.find(entry);
+  if (cachedMsg)
   {
-    auto it = bucket.find(entry);
-    if (it != bucket.end())
+    BfcpMsgPtr fragMsg = *cachedMsg;
+    fragMsg->addFragment(msg);
+    if (!fragMsg->valid())
+    {
+      LOG_WARN << "Invalid fragments: " << fragMsg->toString();
+      cachedFragments_.erase(entry);
+    }
+    else if (fragMsg->isComplete())
     {
-      BfcpMsgPtr &fragMsg = (*it).second;
-      fragMsg->addFragment(msg);
-      if (!fragMsg->valid())
-      {
-        LOG_WARN << "Invalid fragments: " << fragMsg->toString();
-        bucket.erase(it);
-      }
-      else if (fragMsg->isComplete())
-      {
-        LOG_DEBUG << "Complete fragments: " << fragMsg->toString();
-        completedMsg = fragMsg;
-        bucket.erase(it);
-        return false;
-      }
-      return true;
+      LOG_DEBUG << "Complete fragments: " << fragMsg->toString();
+      completedMsg = fragMsg;
+      cachedFragments_.erase(entry);
+      return false;
     }
+    return true;
   }
 
   // this msg is first received fragment
   LOG_DEBUG << "Insert new fragments: " << msg->toString();
-  cachedFragments_.back().insert(std::make_pair(entry, msg));
+  cachedFragments_.insert(entry, msg);
   return true;
 }
 
@@ -179,11 +191,11 @@ bool BfcpConnection::tryHandleResponse(const BfcpMsgPtr &msg)
   if (!msg->isResponse()) return false;
 
   ::bfcp_entity entity = msg->getEntity();
-  auto it = ctrans_.find(entity);
-  if (it != ctrans_.end())
+  ClientTransactionPtr *ctran = ctrans_.find(entity);
+  if (ctran)
   {
-    (*it).second->onResponse(ResponseError::kNoError, msg);
-    ctrans_.erase(it);
+    (*ctran)->onResponse(ResponseError::kNoError, msg);
+    ctrans_.erase(entity);
     return true;
   }
 
@@ -198,18 +210,15 @@ bool BfcpConnection::tryHandleRequest(const BfcpMsgPtr &msg)
   entry.prim = msg->primitive();
   entry.entity = msg->getEntity();
 
-  for (auto &bucket : cachedReplys_)
+  MBufList *bufs = cachedReplys_.find(entry);
+  if (bufs)
   {
-    auto it = bucket.find(entry);
-    if (it != bucket.end())
+    LOG_INFO << "Reply BFCP message" << msg->toString() << " with cached reply";
+    for (auto &buf : *bufs)
     {
-      LOG_INFO << "Reply BFCP message" << msg->toString() << " with cached reply";
-      for (auto &buf : (*it).second)
-      {
-        socket_->send(msg->getSrc(), buf->buf, static_cast<int>(buf->end));
-      }
-      return true;
+      sender_->send(msg->getSrc(), &*buf);
     }
+    return true;
   }
 
   return false;
@@ -217,12 +226,13 @@ bool BfcpConnection::tryHandleRequest(const BfcpMsgPtr &msg)
 
 void BfcpConnection::onRequestTimeout(const ClientTransactionPtr &transaction)
 {
-  auto it = ctrans_.find(transaction->getEntity());
-  if (it != ctrans_.end())
+  const bfcp_entity &entity = transaction->getEntity();
+  ClientTransactionPtr *ctran = ctrans_.find(entity);
+  if (ctran)
   {
     BfcpMsgPtr msg = boost::make_shared<BfcpMsg>();
-    (*it).second->onResponse(ResponseError::kTimeout, msg);
-    ctrans_.erase(it);
+    (*ctran)->onResponse(ResponseError::kTimeout, msg);
+    ctrans_.erase(entity);
   }
   else
   {
@@ -297,8 +307,9 @@ void BfcpConnection::notifyFloorStatusInLoop(const BasicRequestParam &basicParam
 {
   LOG_INFO << "Notify FloorStatus {cid=" << basicParam.conferenceID
            << ",uid=" << basicParam.userID << "}";
-  sendRequestInLoop(
-    boost::bind(&build_msg_FloorStatus, _1, false, _2, _3, _4), 
+  sendEncodedRequestInLoop(
+    boost::bind(&encode_msg_FloorStatus, 
+      _1, MAX_MSG_SIZE, mbufPool_.get(), false, _2, _3, _4), 
     basicParam, 
     floorStatus);
 }
@@ -310,20 +321,83 @@ void BfcpConnection::notifyFloorRequestStatusInLoop(const BasicRequestParam &bas
            << basicParam.conferenceID
            << ",uid=" << basicParam.userID << "}";
 
-  sendRequestInLoop(
-    boost::bind(&build_msg_FloorRequestStatus, _1, false, _2, _3, _4),
+  sendEncodedRequestInLoop(
+    boost::bind(&encode_msg_FloorRequestStatus, 
+      _1, MAX_MSG_SIZE, mbufPool_.get(), false, _2, _3, _4),
     basicParam,
     frqInfo);
 }
 
+EncodedMsgPtr BfcpConnection::encodeFloorStatus(uint32_t conferenceID,
+                                                const FloorStatusParam &floorStatus)
+{
+  bfcp_entity entity;
+  entity.conferenceID = conferenceID;
+  entity.transactionID = 0;
+  entity.userID = 0;
+
+  std::vector<mbuf_t*> bufs;
+  int err = encode_msg_FloorStatus(
+    bufs, MAX_MSG_SIZE, mbufPool_.get(), false, BFCP_VER2, entity, floorStatus);
+  if (err)
+  {
+    LOG_ERROR << "Failed to encode FloorStatus: " << strerror_tl(err);
+    return nullptr;
+  }
+  return boost::make_shared<EncodedMsg>(BFCP_FLOOR_STATUS, bufs);
+}
+
+EncodedMsgPtr BfcpConnection::encodeFloorRequestStatus(uint32_t conferenceID,
+                                                       const FloorRequestInfoParam &frqInfo)
+{
+  bfcp_entity entity;
+  entity.conferenceID = conferenceID;
+  entity.transactionID = 0;
+  entity.userID = 0;
+
+  std::vector<mbuf_t*> bufs;
+  int err = encode_msg_FloorRequestStatus(
+    bufs, MAX_MSG_SIZE, mbufPool_.get(), false, BFCP_VER2, entity, frqInfo);
+  if (err)
+  {
+    LOG_ERROR << "Failed to encode FloorRequestStatus: " << strerror_tl(err);
+    return nullptr;
+  }
+  return boost::make_shared<EncodedMsg>(BFCP_FLOOR_REQUEST_STATUS, bufs);
+}
+
+void BfcpConnection::notifyWithEncodedMsgInLoop(const BasicRequestParam &basicParam,
+                                                const EncodedMsgPtr &msg)
+{
+  loop_->assertInLoopThread();
+  LOG_INFO << "Notify " << bfcp_prim_name(msg->primitive()) 
+           << " {cid=" << basicParam.conferenceID
+           << ",uid=" << basicParam.userID << "}";
+
+  bfcp_entity entity;
+  initEntity(entity, basicParam.conferenceID, basicParam.userID);
+
+  std::vector<mbuf_t*> fragBufs;
+  int err = copy_msg_with_entity(
+    fragBufs, msg->getBufs(), entity, mbufPool_.get());
+  if (err)
+  {
+    // FIXME: notify the caller
+    LOG_ERROR << "Failed to copy BFCP message " << toString(entity)
+              << ": " << strerror_tl(err);
+    return;
+  }
+
+  startNewClientTransaction(basicParam.dst, entity, fragBufs, basicParam.cb);
+}
+
 template <typename BuildMsgFunc>
 void bfcp::BfcpConnection::sendRequestInLoop(BuildMsgFunc buildFunc, 
                                              const BasicRequestParam &basicParam)
 {
   loop_->assertInLoopThread();
 
-  // FIXME: get msg buf from pool
-  mbuf_t *msgBuf = mbuf_alloc(BFCP_MBUF_SIZE);
+  mbuf_t *msgBuf = mbufPool_->alloc(BFCP_MBUF_SIZE);
   detail::AutoDeref derefer(msgBuf);
   if (!msgBuf)
   {
@@ -348,8 +422,7 @@ void bfcp::BfcpConnection::sendRequestInLoop(BuildMsgFunc buildFunc,
 {
   loop_->assertInLoopThread();
 
-  // FIXME: get msg buf from pool
-  mbuf_t *msgBuf = mbuf_alloc(BFCP_MBUF_SIZE);
+  mbuf_t *msgBuf = mbufPool_->alloc(BFCP_MBUF_SIZE);
   detail::AutoDeref derefer(msgBuf);
   if (!msgBuf)
   {
@@ -367,28 +440,69 @@ void bfcp::BfcpConnection::sendRequestInLoop(BuildMsgFunc buildFunc,
   startNewClientTransaction(basicParam.dst, entity, msgBuf, basicParam.cb);
 }
 
+template <typename EncodeMsgFunc, typename ExtParam>
+void bfcp::BfcpConnection::sendEncodedRequestInLoop(EncodeMsgFunc encodeFunc,
+                                                    const BasicRequestParam &basicParam,
+                                                    const ExtParam &extParam)
+{
+  loop_->assertInLoopThread();
+
+  bfcp_entity entity;
+  initEntity(entity, basicParam.conferenceID, basicParam.userID);
+
+  std::vector<mbuf_t*> fragBufs;
+  int err = encodeFunc(fragBufs, BFCP_VER2, entity, extParam);
+  if (err)
+  {
+    // FIXME: notify the caller
+    LOG_ERROR << "Failed to encode BFCP message " << toString(entity)
+              << ": " << strerror_tl(err);
+    return;
+  }
+
+  startNewClientTransaction(basicParam.dst, entity, fragBufs, basicParam.cb);
+}
+
 void BfcpConnection::startNewClientTransaction(const muduo::net::InetAddress &dst,
                                                const bfcp_entity &entity,
                                                mbuf_t *msgBuf,
                                                const ResponseCallback &cb)
 {
-  LOG_INFO << "Start new client transaction " << toString(entity);
-
   msgBuf->pos = 0;
   std::vector<mbuf_t*> fragBufs;
-  int err = build_msg_fragments(fragBufs, msgBuf, MAX_MSG_SIZE);
+  int err = build_msg_fragments(fragBufs, msgBuf, MAX_MSG_SIZE, mbufPool_.get());
   // FIXME: check error
   (void)(err);
 
+  startNewClientTransaction(dst, entity, fragBufs, cb);
+}
+
+void BfcpConnection::startNewClientTransaction(const muduo::net::InetAddress &dst,
+                                               const bfcp_entity &entity,
+                                               std::vector<mbuf_t*> &fragBufs,
+                                               const ResponseCallback &cb)
+{
+  LOG_INFO << "Start new client transaction " << toString(entity);
+
   ClientTransactionPtr ctran = 
-    boost::make_shared<ClientTransaction>(loop_, socket_, dst, entity, fragBufs);
+    boost::make_shared<ClientTransaction>(
+      loop_, &timingWheel_, sender_, dst, entity, fragBufs);
 
   ctran->setReponseCallback(cb);
   ctran->setRequestTimeoutCallback(
     boost::bind(&BfcpConnection::onRequestTimeout, this, _1));
 
-  ctrans_.insert(std::make_pair(entity, ctran));
+  ctrans_.insert(entity, ctran);
   ctran->start();
+
+  if (!retransmitTimerStarted_)
+  {
+    // FIXME: unsafe
+    retransmitTimer_ = loop_->runEvery(
+      timingWheel_.getTickInSec(), 
+      boost::bind(&BfcpConnection::onRetransmitTick, this));
+    retransmitTimerStarted_ = true;
+  }
 }
 
 void BfcpConnection::replyWithUserStatusInLoop(const BfcpMsgPtr &msg, 
@@ -396,7 +510,11 @@ void BfcpConnection::replyWithUserStatusInLoop(const BfcpMsgPtr &msg,
 { 
   assert(msg->primitive() == BFCP_USER_QUERY);
   LOG_INFO << "Reply with UserStatus to " << msg->toString();
-  sendReplyInLoop(&build_msg_UserStatus, msg, userStatus); 
+  sendEncodedReplyInLoop(
+    boost::bind(&encode_msg_UserStatus, 
+      _1, MAX_MSG_SIZE, mbufPool_.get(), _2, _3, _4),
+    msg, 
+    userStatus);
 }
 
 void BfcpConnection::replyWithChairActionAckInLoop( const BfcpMsgPtr &msg )
@@ -447,8 +565,9 @@ void BfcpConnection::replyWithFloorRequestStatusInLoop(const BfcpMsgPtr &msg,
          msg->primitive() == BFCP_FLOOR_REQUEST ||
          msg->primitive() == BFCP_FLOOR_RELEASE);
   LOG_INFO << "Reply with FloorRequestStatus to " << msg->toString();
-  sendReplyInLoop(
-    boost::bind(&build_msg_FloorRequestStatus, _1, true, _2, _3, _4),
+  sendEncodedReplyInLoop(
+    boost::bind(&encode_msg_FloorRequestStatus, 
+      _1, MAX_MSG_SIZE, mbufPool_.get(), true, _2, _3, _4),
     msg,
     frqInfo);
 }
@@ -458,8 +577,9 @@ void BfcpConnection::replyWithFloorStatusInLoop(const BfcpMsgPtr &msg,
 {
   assert(msg->primitive() == BFCP_FLOOR_QUERY);
   LOG_INFO << "Reply with FloorStatus to " << msg->toString();
-  sendReplyInLoop(
-    boost::bind(&build_msg_FloorStatus, _1, true, _2, _3, _4),
+  sendEncodedReplyInLoop(
+    boost::bind(&encode_msg_FloorStatus, 
+      _1, MAX_MSG_SIZE, mbufPool_.get(), true, _2, _3, _4),
     msg, 
     floorStatus);
 }
@@ -471,7 +591,7 @@ void bfcp::BfcpConnection::sendReplyInLoop(BuildMsgFunc buildFunc, const BfcpMsg
   assert(msg->valid());
   assert(!msg->isResponse());
 
-  mbuf_t *msgBuf = mbuf_alloc(BFCP_MBUF_SIZE);
+  mbuf_t *msgBuf = mbufPool_->alloc(BFCP_MBUF_SIZE);
   detail::AutoDeref derefer(msgBuf);
   if (!msgBuf)
   {
@@ -496,7 +616,7 @@ void bfcp::BfcpConnection::sendReplyInLoop(BuildMsgFunc buildFunc,
   assert(msg->valid());
   assert(!msg->isResponse());
 
-  mbuf_t *msgBuf = mbuf_alloc(BFCP_MBUF_SIZE);
+  mbuf_t *msgBuf = mbufPool_->alloc(BFCP_MBUF_SIZE);
   detail::AutoDeref derefer(msgBuf);
   if (!msgBuf)
   {
@@ -512,18 +632,48 @@ void bfcp::BfcpConnection::sendReplyInLoop(BuildMsgFunc buildFunc,
   startNewServerTransaction(msg->getSrc(), entity, msg->primitive(), msgBuf);
 }
 
+template <typename EncodeMsgFunc, typename ExtParam>
+void bfcp::BfcpConnection::sendEncodedReplyInLoop(EncodeMsgFunc encodeFunc,
+                                                  const BfcpMsgPtr &msg,
+                                                  const ExtParam &extParam)
+{
+  loop_->assertInLoopThread();
+  assert(msg->valid());
+  assert(!msg->isResponse());
+
+  bfcp_entity entity = msg->getEntity();
+  std::vector<mbuf_t*> fragBufs;
+  int err = encodeFunc(fragBufs, msg->getVersion(), entity, extParam);
+  if (err)
+  {
+    LOG_ERROR << "Failed to encode BFCP message " << toString(entity)
+              << ": " << strerror_tl(err);
+    return;
+  }
+
+  startNewServerTransaction(msg->getSrc(), entity, msg->primitive(), fragBufs);
+}
+
 void BfcpConnection::startNewServerTransaction(const muduo::net::InetAddress &dst,
                                                const bfcp_entity &entity, 
                                                bfcp_prim primitive, 
                                                mbuf_t *msgBuf)
 {
-  LOG_INFO << "Start new server transaction to " << toString(entity, primitive);
-  
   msgBuf->pos = 0;
   std::vector<mbuf_t*> fragBufs;
-  int err = build_msg_fragments(fragBufs, msgBuf, MAX_MSG_SIZE);
+  int err = build_msg_fragments(fragBufs, msgBuf, MAX_MSG_SIZE, mbufPool_.get());
   // FIXME: check error
   (void)(err);
+
+  startNewServerTransaction(dst, entity, primitive, fragBufs);
+}
+
+void BfcpConnection::startNewServerTransaction(const muduo::net::InetAddress &dst,
+                                               const bfcp_entity &entity,
+                                               bfcp_prim primitive,
+                                               std::vector<mbuf_t*> &fragBufs)
+{
+  LOG_INFO << "Start new server transaction to " << toString(entity, primitive);
   
   MBufList bufs;
   bufs.reserve(fragBufs.size());
@@ -535,17 +685,22 @@ void BfcpConnection::startNewServerTransaction(const muduo::net::InetAddress &ds
   }
   fragBufs.clear();
 
-  if (currentCachedReplys_ < MAX_CACHED_REPLY_SIZE) {
-    detail::bfcp_strans_entry entry;
-    entry.entity = entity;
-    entry.prim = primitive;
-    cachedReplys_.back().insert(std::make_pair(entry, bufs));
-    ++currentCachedReplys_;
+  size_t bytes = 0;
+  for (auto &buf : bufs)
+  {
+    bytes += buf->size;
+  }
+  detail::bfcp_strans_entry entry;
+  entry.entity = entity;
+  entry.prim = primitive;
+  if (!cachedReplys_.insert(entry, bufs, bytes))
+  {
+    LOG_WARN << "Cannot cache the reply " << toString(entity, primitive);
   }
 
   for (auto &buf : bufs)
   {
-    socket_->send(dst, buf->buf, static_cast<int>(buf->end));
+    sender_->send(dst, &*buf);
   }
 }
 
@@ -1,14 +1,14 @@
 #ifndef BFCP_CONN_H
 #define BFCP_CONN_H
 
+#include <utility>
 #include <vector>
-#include <map>
 
 #include <boost/noncopyable.hpp>
 #include <boost/bind.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/circular_buffer.hpp>
+#include <boost/make_shared.hpp>
 
 #include <muduo/base/Timestamp.h>
 #include <muduo/net/Callbacks.h>
@@ -16,11 +16,16 @@
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/InetAddress.h>
 
+#include <bfcp/common/bfcp_batch_sender.h>
 #include <bfcp/common/bfcp_callbacks.h>
+#include <bfcp/common/bfcp_entity_map.h>
 #include <bfcp/common/bfcp_ex.h>
+#include <bfcp/common/bfcp_mbuf_pool.h>
 #include <bfcp/common/bfcp_mbuf_wrapper.h>
 #include <bfcp/common/bfcp_param.h>
+#include <bfcp/common/bfcp_timing_wheel.h>
 #include <bfcp/common/bfcp_msg.h>
+#include <bfcp/common/bfcp_msg_cache.h>
 
 namespace bfcp
 {
@@ -28,26 +33,6 @@ namespace bfcp
 class ClientTransaction;
 typedef boost::shared_ptr<ClientTransaction> ClientTransactionPtr;
 
-namespace detail
-{
-
-typedef struct bfcp_msg_entry
-{
-  bfcp_prim prim;
-  bfcp_entity entity;
-} bfcp_msg_entry;
-
-inline bool operator<(const bfcp_msg_entry &lhs, const bfcp_msg_entry &rhs)
-{
-  int r = compare(lhs.entity, rhs.entity);
-  if (r < 0) return true;
-  if (r == 0) return lhs.prim < rhs.prim;
-  return false;
-}
-
-typedef bfcp_msg_entry bfcp_strans_entry;
-
-} // namespace detail
 
 class BasicRequestParam
 {
@@ -74,6 +59,35 @@ public:
   uint16_t userID;
 };
 
+// msg encoded once and sent to many users,
+// only the header of each copy is patched with the user's entity
+class EncodedMsg : boost::noncopyable
+{
+public:
+  EncodedMsg(bfcp_prim primitive, std::vector<mbuf_t*> &bufs)
+      : primitive_(primitive)
+  {
+    bufs_.swap(bufs);
+  }
+
+  ~EncodedMsg()
+  {
+    for (auto buf : bufs_)
+    {
+      mem_deref(buf);
+    }
+  }
+
+  bfcp_prim primitive() const { return primitive_; }
+  const std::vector<mbuf_t*>& getBufs() const { return bufs_; }
+
+private:
+  bfcp_prim primitive_;
+  std::vector<mbuf_t*> bufs_;
+};
+
+typedef boost::shared_ptr<const EncodedMsg> EncodedMsgPtr;
+
 class BfcpConnection : public boost::shared_ptr<BfcpConnection>,
                        boost::noncopyable
 {
@@ -83,6 +97,13 @@ public:
 
   muduo::net::EventLoop* getEventLoop() { return loop_; }
 
+  // counters of the pool building the outgoing msgs
+  MBufPool::Stats getMBufPoolStats() const { return mbufPool_->getStats(); }
+
+  // NOTE: should be called in loop thread
+  const BatchSender::Stats& getBatchSendStats() const 
+  { return sender_->getStats(); }
+
   // FIXME:
   // this should be called once
   void stopCacheTimer(); 
@@ -92,6 +113,12 @@ public:
     const muduo::net::InetAddress &src,
     muduo::Timestamp receivedTime);
 
+  // NOTE: should be called in loop thread
+  // the replies are cached for BFCP_T2_SEC to answer the retransmitted 
+  // requests, the oldest ones are evicted if they exceed maxBytes.
+  void setMaxCachedReplyBytes(size_t maxBytes) 
+  { cachedReplys_.setMaxBytes(maxBytes); }
+
   void setNewRequestCallback(const NewRequestCallback &cb)
   { newRequestCallback_ = cb; }
 
@@ -122,24 +149,42 @@ public:
   void sendGoodbye(const BasicRequestParam &basicParam)
   { runInLoop(&BfcpConnection::sendGoodbyeInLoop, basicParam); }
 
+  // NOTE: the overloads taking the params by rvalue move them
+  // into the loop instead of copying them
+
   void replyWithFloorRequestStatus(const BfcpMsgPtr &msg, const FloorRequestInfoParam &frqInfo)
   { runInLoop(&BfcpConnection::replyWithFloorRequestStatusInLoop, msg, frqInfo); }
 
+  void replyWithFloorRequestStatus(const BfcpMsgPtr &msg, FloorRequestInfoParam &&frqInfo)
+  { moveInLoop(&BfcpConnection::replyWithFloorRequestStatusInLoop, msg, std::move(frqInfo)); }
+
   void replyWithFloorStatus(const BfcpMsgPtr &msg, const FloorStatusParam &floorStatus) 
   { runInLoop(&BfcpConnection::replyWithFloorStatusInLoop, msg, floorStatus); }
 
+  void replyWithFloorStatus(const BfcpMsgPtr &msg, FloorStatusParam &&floorStatus) 
+  { moveInLoop(&BfcpConnection::replyWithFloorStatusInLoop, msg, std::move(floorStatus)); }
+
   void replyWithUserStatus(const BfcpMsgPtr &msg, const UserStatusParam &userStatus)
   { runInLoop(&BfcpConnection::replyWithUserStatusInLoop, msg, userStatus); }
 
+  void replyWithUserStatus(const BfcpMsgPtr &msg, UserStatusParam &&userStatus)
+  { moveInLoop(&BfcpConnection::replyWithUserStatusInLoop, msg, std::move(userStatus)); }
+
   void replyWithChairActionAck(const BfcpMsgPtr &msg) 
   { runInLoop(&BfcpConnection::replyWithChairActionAckInLoop, msg); }
 
   void replyWithHelloAck(const BfcpMsgPtr &msg, const HelloAckParam &helloAck)
   { runInLoop(&BfcpConnection::replyWithHelloAckInLoop, msg, helloAck); }
 
+  void replyWithHelloAck(const BfcpMsgPtr &msg, HelloAckParam &&helloAck)
+  { moveInLoop(&BfcpConnection::replyWithHelloAckInLoop, msg, std::move(helloAck)); }
+
   void replyWithError(const BfcpMsgPtr &msg, const ErrorParam &error)
   { runInLoop(&BfcpConnection::replyWithErrorInLoop, msg, error); }
 
+  void replyWithError(const BfcpMsgPtr &msg, ErrorParam &&error)
+  { moveInLoop(&BfcpConnection::replyWithErrorInLoop, msg, std::move(error)); }
+
   void replyWithFloorRequestStatusAck(const BfcpMsgPtr &msg)
   { runInLoop(&BfcpConnection::replyWithFloorRequestStatusAckInLoop, msg); }
 
@@ -149,30 +194,50 @@ public:
   void replyWithGoodbyeAck(const BfcpMsgPtr &msg)
   { runInLoop(&BfcpConnection::replyWithGoodbyeAckInLoop, msg); }
 
-  // FIXME: make frqInfo to smart pointer
   void notifyFloorRequestStatus(const BasicRequestParam &basicParam, 
                                 const FloorRequestInfoParam &frqInfo)
   {
     runInLoop(&BfcpConnection::notifyFloorRequestStatusInLoop, basicParam, frqInfo);
   }
 
-  // FIXME: make floorStatusParam to smart pointer
   void notifyFloorStatus(const BasicRequestParam &basicParam, 
     const FloorStatusParam &floorStatus)
   { 
     runInLoop(&BfcpConnection::notifyFloorStatusInLoop, basicParam, floorStatus); 
   }
 
+  // encode the notification once for broadcasting, thread safe, 
+  // return null if failed to encode
+  EncodedMsgPtr encodeFloorStatus(uint32_t conferenceID, 
+                                  const FloorStatusParam &floorStatus);
+  EncodedMsgPtr encodeFloorRequestStatus(uint32_t conferenceID, 
+                                         const FloorRequestInfoParam &frqInfo);
+
+  // start a new client transaction with a copy of the encoded msg
+  void notifyWithEncodedMsg(const BasicRequestParam &basicParam,
+                            const EncodedMsgPtr &msg)
+  {
+    runInLoop(&BfcpConnection::notifyWithEncodedMsgInLoop, basicParam, msg);
+  }
+
+  void notifyWithEncodedMsg(BasicRequestParam &&basicParam,
+                            const EncodedMsgPtr &msg)
+  {
+    moveInLoop(&BfcpConnection::notifyWithEncodedMsgInLoop, 
+               std::move(basicParam), msg);
+  }
+
 private:
   static const int BFCP_T2_SEC = 10;
-  static const int BFCP_MBUF_SIZE = 65536;
+  // tick of the timing wheel driving the retransmissions
+  static const int BFCP_TICK_MSEC = 50;
+  // initial buf size to build msg, the buf grows if the msg is larger
+  static const size_t BFCP_MBUF_SIZE = MBufPool::kMediumSize;
   static const size_t MAX_MSG_SIZE = 1472;
-  static const size_t MAX_CACHED_REPLY_SIZE = 100;
+  static const size_t DEFAULT_MAX_CACHED_REPLY_BYTES = 32 * 1024 * 1024;
 
   typedef MBufWrapper MBufPtr;
   typedef std::vector<MBufPtr> MBufList;
-  typedef std::map<detail::bfcp_strans_entry, MBufList> ReplyBucket;
-  typedef std::map<detail::bfcp_msg_entry, BfcpMsgPtr> FragmentBucket;
 
   template <typename Func, typename Arg1>
   void runInLoop(Func requestFunc, const Arg1 &basic);
@@ -180,6 +245,13 @@ private:
   template <typename Func, typename Arg1, typename Arg2>
   void runInLoop(Func requestFunc, const Arg1 &basic, const Arg2 &ext);
 
+  // the args are taken by value, pass them by std::move
+  template <typename Func, typename Arg1, typename Arg2>
+  void moveInLoop(Func requestFunc, Arg1 basic, Arg2 ext);
+
+  template <typename Func, typename Arg1, typename Arg2>
+  class MovedArgsCall;
+
   template <typename BuildMsgFunc>
   void sendRequestInLoop(BuildMsgFunc buildFunc, 
                          const BasicRequestParam &basicParam);
@@ -189,12 +261,22 @@ private:
                          const BasicRequestParam &basicParam, 
                          const ExtParam &extParam);
 
+  template <typename EncodeMsgFunc, typename ExtParam>
+  void sendEncodedRequestInLoop(EncodeMsgFunc encodeFunc,
+                                const BasicRequestParam &basicParam,
+                                const ExtParam &extParam);
+
   template <typename BuildMsgFunc>
   void sendReplyInLoop(BuildMsgFunc buildFunc, const BfcpMsgPtr &msg);
 
   template <typename BuildMsgFunc, typename ExtParam>
   void sendReplyInLoop(BuildMsgFunc buildFunc, const BfcpMsgPtr &msg, const ExtParam &extParam);
 
+  template <typename EncodeMsgFunc, typename ExtParam>
+  void sendEncodedReplyInLoop(EncodeMsgFunc encodeFunc, 
+                              const BfcpMsgPtr &msg, 
+                              const ExtParam &extParam);
+
   bool tryHandleFragmentMessage(const BfcpMsgPtr &msg, BfcpMsgPtr &completedMsg);
   bool tryHandleMessageError(const BfcpMsgPtr &msg);
   bool tryHandleResponse(const BfcpMsgPtr &msg);
@@ -202,6 +284,7 @@ private:
   void onRequestTimeout(const ClientTransactionPtr &ctran);
   void onMessageInLoop(const BfcpMsgPtr &msg);
   void onTimer();
+  void onRetransmitTick();
 
   void sendFloorRequestInLoop(const BasicRequestParam &basicParam, const FloorRequestParam &floorRequest);
   void sendFloorReleaseInLoop(const BasicRequestParam &basicParam, uint16_t floorRequestID);
@@ -226,6 +309,8 @@ private:
                                       const FloorRequestInfoParam &frqInfo);
   void notifyFloorStatusInLoop(const BasicRequestParam &basicParam, 
                                const FloorStatusParam &floorStatus);
+  void notifyWithEncodedMsgInLoop(const BasicRequestParam &basicParam,
+                                  const EncodedMsgPtr &msg);
   
   inline void initEntity(bfcp_entity &entity, uint32_t cid, uint16_t uid);
   inline uint16_t getNextTransactionID();
@@ -235,23 +320,38 @@ private:
                                  mbuf_t *msgBuf,
                                  const ResponseCallback &cb);
 
+  // take the ownership of the fragment bufs
+  void startNewClientTransaction(const muduo::net::InetAddress &dst,
+                                 const bfcp_entity &entity,
+                                 std::vector<mbuf_t*> &fragBufs,
+                                 const ResponseCallback &cb);
+
   void startNewServerTransaction(const muduo::net::InetAddress &dst,
                                  const bfcp_entity &entity,
                                  bfcp_prim primitive,
                                  mbuf_t *msgBuf);
 
+  // take the ownership of the fragment bufs
+  void startNewServerTransaction(const muduo::net::InetAddress &dst,
+                                 const bfcp_entity &entity,
+                                 bfcp_prim primitive,
+                                 std::vector<mbuf_t*> &fragBufs);
+
 private:
   muduo::net::EventLoop *loop_;
   muduo::net::UdpSocketPtr socket_;
-  // FIXME: use std::unordered_map instead?
-  std::map<::bfcp_entity, ClientTransactionPtr> ctrans_;
+  BatchSenderPtr sender_;
+  MBufPoolPtr mbufPool_;
+  EntityMap<ClientTransactionPtr> ctrans_;
+  TimingWheel timingWheel_;
+  muduo::net::TimerId retransmitTimer_;
+  bool retransmitTimerStarted_;
   NewRequestCallback newRequestCallback_;
 
-  boost::circular_buffer<ReplyBucket> cachedReplys_;
-  size_t currentCachedReplys_;
+  MsgCache<MBufList> cachedReplys_;
   muduo::net::TimerId responseTimer_;
   
-  boost::circular_buffer<FragmentBucket> cachedFragments_;
+  MsgCache<BfcpMsgPtr> cachedFragments_;
   
   uint16_t nextTid_;
   bool timerNeedStop_;
@@ -270,7 +370,7 @@ void BfcpConnection::runInLoop(Func func, const Arg1 &arg1)
     loop_->runInLoop(
       boost::bind(func, 
         this, // FIXME
-        arg1)); // std::move?
+        arg1)); // copied
   }
 }
 
@@ -286,8 +386,45 @@ void BfcpConnection::runInLoop(Func func, const Arg1 &arg1, const Arg2 &arg2)
     loop_->runInLoop(
       boost::bind(func, 
         this, // FIXME
-        arg1, // std::move?
-        arg2)); // std::move?
+        arg1, // copied, moveInLoop moves them
+        arg2));
+  }
+}
+
+// the args are moved into one snapshot shared by the copies of the call,
+// so queuing it to the loop doesn't copy the params
+template <typename Func, typename Arg1, typename Arg2>
+class BfcpConnection::MovedArgsCall
+{
+public:
+  MovedArgsCall(BfcpConnection *connection, Func func, Arg1 &&arg1, Arg2 &&arg2)
+      : connection_(connection),
+        func_(func),
+        args_(boost::make_shared<Args>(std::move(arg1), std::move(arg2)))
+  {}
+
+  void operator()() const { (connection_->*func_)(args_->first, args_->second); }
+
+private:
+  typedef std::pair<Arg1, Arg2> Args;
+
+  BfcpConnection *connection_; // FIXME
+  Func func_;
+  boost::shared_ptr<const Args> args_;
+};
+
+template <typename Func, typename Arg1, typename Arg2>
+void BfcpConnection::moveInLoop(Func func, Arg1 arg1, Arg2 arg2)
+{
+  if (loop_->isInLoopThread())
+  {
+    (this->*func)(arg1, arg2);
+  }
+  else
+  {
+    loop_->runInLoop(
+      MovedArgsCall<Func, Arg1, Arg2>(
+        this, func, std::move(arg1), std::move(arg2)));
   }
 }
 
@@ -5,7 +5,6 @@
 
 #include <boost/bind.hpp>
 
-using muduo::net::UdpSocketPtr;
 using muduo::net::EventLoop;
 using muduo::net::InetAddress;
 
@@ -31,16 +30,19 @@ void defaultResponseCallback(ResponseError err, const BfcpMsgPtr &msg)
 }
 
 ClientTransaction::ClientTransaction(muduo::net::EventLoop *loop, 
-                                     const muduo::net::UdpSocketPtr &socket, 
+                                     TimingWheel *timingWheel,
+                                     const BatchSenderPtr &sender, 
                                      const muduo::net::InetAddress &dst, 
                                      const bfcp_entity &entity, 
                                      std::vector<mbuf_t*> &msgBufs)
     : loop_(CHECK_NOTNULL(loop)),
-      socket_(socket),
+      timingWheel_(CHECK_NOTNULL(timingWheel)),
+      sender_(sender),
       entity_(entity),
       dst_(dst), 
       responseCallback_(defaultResponseCallback),
-      txc_(1)
+      txc_(1),
+      finished_(false)
 {
   assert(!msgBufs.empty());
   bufs_.swap(msgBufs);
@@ -60,28 +62,29 @@ void ClientTransaction::start()
   sendBufs();
 
   txc_ = 1;
-  timer1_ = loop_->runAfter(
-    BFCP_T1 / 1000.0, boost::bind(&ClientTransaction::onSendTimeout, shared_from_this()));
+  timingWheel_->schedule(shared_from_this(), BFCP_T1 / 1000.0);
 }
 
 void ClientTransaction::sendBufs()
 {
-  UdpSocketPtr socket = socket_.lock();
-  assert(socket);
+  BatchSenderPtr sender = sender_.lock();
+  assert(sender);
 
   for (auto &buf : bufs_)
   {
-    socket->send(dst_, buf->buf, static_cast<int>(buf->end));
+    sender->send(dst_, buf);
   }
 }
 
 void ClientTransaction::onSendTimeout()
 {
   loop_->assertInLoopThread();
+  if (finished_) return;
 
   double delay = (BFCP_T1 << txc_) / 1000.0;
   if (++txc_ > BFCP_TXC)
   {
+    finished_ = true;
     if (requestTimeoutCallback_)
     {
       loop_->queueInLoop(
@@ -90,22 +93,22 @@ void ClientTransaction::onSendTimeout()
     return;
   }
 
-  UdpSocketPtr socket = socket_.lock();
-  if (!socket)
+  BatchSenderPtr sender = sender_.lock();
+  if (!sender)
   {
-    LOG_WARN << "UDP socket has been destructed before ClientTransaction::onSendTimeout";
+    LOG_WARN << "BatchSender has been destructed before ClientTransaction::onSendTimeout";
   }
   else
   {
     sendBufs();
-    timer1_ = loop_->runAfter(
-      delay, boost::bind(&ClientTransaction::onSendTimeout, this));
+    timingWheel_->schedule(shared_from_this(), delay);
   }
 }
 
 void ClientTransaction::onResponse( ResponseError err, const BfcpMsgPtr &msg )
 {
-  loop_->cancel(timer1_);
+  // the scheduled timeout is dropped by onSendTimeout
+  finished_ = true;
   if (err != ResponseError::kNoError)
   {
     LOG_INFO << "Client transaction" << toString(entity_)
@@ -9,12 +9,12 @@
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
-#include <muduo/net/UdpSocket.h>
-#include <muduo/net/TimerId.h>
 #include <muduo/net/InetAddress.h>
 
 #include <bfcp/common/bfcp_msg.h>
 #include <bfcp/common/bfcp_callbacks.h>
+#include <bfcp/common/bfcp_batch_sender.h>
+#include <bfcp/common/bfcp_timing_wheel.h>
 
 namespace bfcp
 {
@@ -32,7 +32,8 @@ public:
   typedef boost::function<void (const ClientTransactionPtr&)> RequestTimeoutCallback;
 
   ClientTransaction(muduo::net::EventLoop *loop,
-                    const muduo::net::UdpSocketPtr &socket,
+                    TimingWheel *timingWheel,
+                    const BatchSenderPtr &sender,
                     const muduo::net::InetAddress &dst, 
                     const bfcp_entity &entity,
                     std::vector<mbuf_t*> &msgBufs);
@@ -43,6 +44,8 @@ public:
   void start();
   // no thread safe
   void onResponse(ResponseError err, const BfcpMsgPtr &msg);
+  // no thread safe, called by TimingWheel
+  void onSendTimeout();
 
   const bfcp_entity& getEntity() const { return entity_; }
 
@@ -59,18 +62,18 @@ public:
   { requestTimeoutCallback_ = std::move(requestTimeoutCallback); }
 
 private:
-  void onSendTimeout();
   void sendBufs();
 
   muduo::net::EventLoop *loop_;
-  boost::weak_ptr<muduo::net::UdpSocket> socket_;
+  TimingWheel *timingWheel_;
+  boost::weak_ptr<BatchSender> sender_;
   std::vector<mbuf_t*> bufs_;
   bfcp_entity entity_;
   muduo::net::InetAddress dst_;
   ResponseCallback responseCallback_;
   RequestTimeoutCallback requestTimeoutCallback_;
-  muduo::net::TimerId timer1_;
   uint8_t txc_;
+  bool finished_;
 };
 
 }
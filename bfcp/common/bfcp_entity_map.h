@@ -0,0 +1,144 @@
+#ifndef BFCP_ENTITY_MAP_H
+#define BFCP_ENTITY_MAP_H
+
+#include <cassert>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <bfcp/common/bfcp_ex.h>
+
+namespace bfcp
+{
+
+// Hash map from bfcp_entity to T, keyed by toKey(entity).
+// It's a flat table with linear probing and backward shift deletion,
+// no node is allocated per insertion.
+// NOTE: the pointer returned by find is invalidated by insert and erase.
+template <typename T>
+class EntityMap : boost::noncopyable
+{
+public:
+  static const size_t kMinCapacity = 16;
+
+  explicit EntityMap(size_t capacity = kMinCapacity)
+      : size_(0)
+  {
+    size_t cap = kMinCapacity;
+    while (cap < capacity) cap <<= 1;
+    slots_.resize(cap);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T* find(const bfcp_entity &entity)
+  {
+    uint64_t key = toKey(entity);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash(key) & mask; slots_[i].used; i = (i + 1) & mask)
+    {
+      if (slots_[i].key == key)
+        return &slots_[i].value;
+    }
+    return nullptr;
+  }
+
+  // return false if the entity already exists
+  bool insert(const bfcp_entity &entity, const T &value)
+  {
+    if ((size_ + 1) * 2 > slots_.size())
+    {
+      rehash(slots_.size() * 2);
+    }
+    uint64_t key = toKey(entity);
+    size_t mask = slots_.size() - 1;
+    size_t i = hash(key) & mask;
+    for (; slots_[i].used; i = (i + 1) & mask)
+    {
+      if (slots_[i].key == key)
+        return false;
+    }
+    slots_[i].key = key;
+    slots_[i].value = value;
+    slots_[i].used = true;
+    ++size_;
+    return true;
+  }
+
+  // return false if the entity is not found
+  bool erase(const bfcp_entity &entity)
+  {
+    uint64_t key = toKey(entity);
+    size_t mask = slots_.size() - 1;
+    size_t i = hash(key) & mask;
+    for (; slots_[i].used; i = (i + 1) & mask)
+    {
+      if (slots_[i].key == key)
+        break;
+    }
+    if (!slots_[i].used) return false;
+
+    // shift the following slots of the probe sequence backward,
+    // so find can stop at the first empty slot
+    for (size_t j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask)
+    {
+      size_t home = hash(slots_[j].key) & mask;
+      bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (between) continue;
+      slots_[i].key = slots_[j].key;
+      slots_[i].value = std::move(slots_[j].value);
+      i = j;
+    }
+    slots_[i].used = false;
+    slots_[i].value = T();
+    --size_;
+    return true;
+  }
+
+private:
+  typedef struct Slot
+  {
+    Slot() : key(0), value(), used(false) {}
+
+    uint64_t key;
+    T value;
+    bool used;
+  } Slot;
+
+  static size_t hash(uint64_t key)
+  {
+    // the finalizer of MurmurHash3,
+    // conferenceID, userID and transactionID all change the low bits
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+
+  void rehash(size_t capacity)
+  {
+    assert((capacity & (capacity - 1)) == 0);
+    std::vector<Slot> oldSlots(capacity);
+    oldSlots.swap(slots_);
+    size_t mask = capacity - 1;
+    for (auto &slot : oldSlots)
+    {
+      if (!slot.used) continue;
+      size_t i = hash(slot.key) & mask;
+      while (slots_[i].used) i = (i + 1) & mask;
+      slots_[i].key = slot.key;
+      slots_[i].value = std::move(slot.value);
+      slots_[i].used = true;
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_ENTITY_MAP_H
@@ -77,16 +77,19 @@ typedef struct bfcp_floor_request_info
 
 typedef std::vector<bfcp_floor_request_info> bfcp_floor_request_info_list;
 
-inline int compare(const bfcp_entity &lhs, const bfcp_entity &rhs)
+// pack the entity into 64 bits: conferenceID | userID | transactionID
+inline uint64_t toKey(const bfcp_entity &entity)
 {
-  uint64_t lvalue = uint64_t(lhs.conferenceID) << 32;
-  lvalue |= uint64_t(lhs.userID) << 16;
-  lvalue |= uint64_t(lhs.transactionID);
-
-  uint64_t rvalue = uint64_t(rhs.conferenceID) << 32;
-  rvalue |= uint64_t(rhs.userID) << 16;
-  rvalue |= uint64_t(rhs.transactionID);
+  uint64_t value = uint64_t(entity.conferenceID) << 32;
+  value |= uint64_t(entity.userID) << 16;
+  value |= uint64_t(entity.transactionID);
+  return value;
+}
 
+inline int compare(const bfcp_entity &lhs, const bfcp_entity &rhs)
+{
+  uint64_t lvalue = toKey(lhs);
+  uint64_t rvalue = toKey(rhs);
   return lvalue < rvalue ? -1 : ((lvalue == rvalue) ? 0 : 1);
 }
 
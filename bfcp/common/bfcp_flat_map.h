@@ -0,0 +1,108 @@
+#ifndef BFCP_FLAT_MAP_H
+#define BFCP_FLAT_MAP_H
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace bfcp
+{
+
+// Ordered map stored in a sorted vector, a drop-in for the std::map
+// which is small or mostly looked up.
+// find and lower_bound are binary searches on contiguous memory,
+// insert and erase move the elements behind.
+// NOTE: the iterators are invalidated by insert and erase,
+// the key of an element must not be modified through the iterator.
+template <typename Key, typename T, typename Compare = std::less<Key> >
+class FlatMap
+{
+public:
+  typedef Key key_type;
+  typedef T mapped_type;
+  typedef std::pair<Key, T> value_type;
+  typedef Compare key_compare;
+  typedef std::vector<value_type> Container;
+  typedef typename Container::iterator iterator;
+  typedef typename Container::const_iterator const_iterator;
+  typedef typename Container::size_type size_type;
+
+  iterator begin() { return elems_.begin(); }
+  iterator end() { return elems_.end(); }
+  const_iterator begin() const { return elems_.begin(); }
+  const_iterator end() const { return elems_.end(); }
+
+  size_type size() const { return elems_.size(); }
+  bool empty() const { return elems_.empty(); }
+  void clear() { elems_.clear(); }
+  void reserve(size_type n) { elems_.reserve(n); }
+  key_compare key_comp() const { return Compare(); }
+
+  iterator lower_bound(const Key &key)
+  {
+    return std::lower_bound(elems_.begin(), elems_.end(), key, KeyLess());
+  }
+
+  const_iterator lower_bound(const Key &key) const
+  {
+    return std::lower_bound(elems_.begin(), elems_.end(), key, KeyLess());
+  }
+
+  iterator find(const Key &key)
+  {
+    iterator it = lower_bound(key);
+    return it != end() && !Compare()(key, (*it).first) ? it : end();
+  }
+
+  const_iterator find(const Key &key) const
+  {
+    const_iterator it = lower_bound(key);
+    return it != end() && !Compare()(key, (*it).first) ? it : end();
+  }
+
+  std::pair<iterator, bool> insert(value_type value)
+  {
+    iterator it = lower_bound(value.first);
+    if (it != end() && !Compare()(value.first, (*it).first))
+    {
+      return std::make_pair(it, false);
+    }
+    return std::make_pair(elems_.insert(it, std::move(value)), true);
+  }
+
+  // insert before hint if it's the right place,
+  // return the element with the same key if there is one
+  iterator insert(iterator hint, value_type value)
+  {
+    if ((hint == end() || Compare()(value.first, (*hint).first)) &&
+        (hint == begin() || Compare()((*(hint - 1)).first, value.first)))
+    {
+      return elems_.insert(hint, std::move(value));
+    }
+    return insert(std::move(value)).first;
+  }
+
+  iterator erase(iterator it) { return elems_.erase(it); }
+
+  size_type erase(const Key &key)
+  {
+    iterator it = find(key);
+    if (it == end()) return 0;
+    elems_.erase(it);
+    return 1;
+  }
+
+private:
+  struct KeyLess
+  {
+    bool operator()(const value_type &lhs, const Key &rhs) const
+    { return Compare()(lhs.first, rhs); }
+  };
+
+  Container elems_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_FLAT_MAP_H
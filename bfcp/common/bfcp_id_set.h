@@ -0,0 +1,211 @@
+#ifndef BFCP_ID_SET_H
+#define BFCP_ID_SET_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include <stdint.h>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace bfcp
+{
+namespace detail
+{
+
+// index of the lowest set bit, word must not be 0
+inline int count_trailing_zeros(uint64_t word)
+{
+  assert(word != 0);
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return static_cast<int>(index);
+#else
+  int n = 0;
+  while (!(word & 1))
+  {
+    word >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+} // namespace detail
+
+// Set of 16-bit IDs, kept as a sorted vector while it's small and
+// switched to a bitmap of the whole ID space when it grows large.
+// The IDs are iterated in ascending order in both forms.
+// Both forms keep their storage once allocated,
+// so insert, erase and clear don't allocate in steady state.
+// NOTE: the iterators are invalidated by insert and erase.
+class IdSet
+{
+public:
+  // 512 bytes of sorted IDs, the bitmap has 8K bytes
+  static const size_t kMaxSortedSize = 256;
+  static const size_t kIdSpace = 65536;
+
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef uint16_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const uint16_t* pointer;
+    typedef uint16_t reference;
+
+    const_iterator() : set_(nullptr), pos_(0) {}
+
+    uint16_t operator*() const
+    { return set_->isBitmap_ ? static_cast<uint16_t>(pos_) : set_->sorted_[pos_]; }
+
+    const_iterator& operator++()
+    {
+      pos_ = set_->isBitmap_ ? set_->nextInBitmap(pos_ + 1) : pos_ + 1;
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const const_iterator &rhs) const { return pos_ == rhs.pos_; }
+    bool operator!=(const const_iterator &rhs) const { return pos_ != rhs.pos_; }
+
+  private:
+    friend class IdSet;
+
+    const_iterator(const IdSet *set, size_t pos) : set_(set), pos_(pos) {}
+
+    const IdSet *set_;
+    size_t pos_; // index in the sorted IDs, or the ID in the bitmap
+  };
+  typedef const_iterator iterator;
+
+  IdSet() : size_(0), isBitmap_(false) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const
+  { return const_iterator(this, isBitmap_ ? nextInBitmap(0) : 0); }
+  const_iterator end() const
+  { return const_iterator(this, isBitmap_ ? kIdSpace : sorted_.size()); }
+
+  bool contains(uint16_t id) const
+  {
+    if (isBitmap_) return testBit(id);
+    return std::binary_search(sorted_.begin(), sorted_.end(), id);
+  }
+
+  // return false if the ID already exists
+  bool insert(uint16_t id)
+  {
+    if (isBitmap_)
+    {
+      if (testBit(id)) return false;
+      bitmap_[id >> 6] |= uint64_t(1) << (id & 63);
+    }
+    else
+    {
+      auto it = std::lower_bound(sorted_.begin(), sorted_.end(), id);
+      if (it != sorted_.end() && *it == id) return false;
+      sorted_.insert(it, id);
+      if (sorted_.size() > kMaxSortedSize)
+      {
+        toBitmap();
+      }
+    }
+    ++size_;
+    return true;
+  }
+
+  // return false if the ID doesn't exist
+  bool erase(uint16_t id)
+  {
+    if (isBitmap_)
+    {
+      if (!testBit(id)) return false;
+      bitmap_[id >> 6] &= ~(uint64_t(1) << (id & 63));
+      --size_;
+      // switch back with hysteresis
+      if (size_ < kMaxSortedSize / 2)
+      {
+        toSorted();
+      }
+    }
+    else
+    {
+      auto it = std::lower_bound(sorted_.begin(), sorted_.end(), id);
+      if (it == sorted_.end() || *it != id) return false;
+      sorted_.erase(it);
+      --size_;
+    }
+    return true;
+  }
+
+  void clear()
+  {
+    sorted_.clear();
+    isBitmap_ = false;
+    size_ = 0;
+  }
+
+private:
+  bool testBit(uint16_t id) const
+  { return (bitmap_[id >> 6] >> (id & 63)) & 1; }
+
+  size_t nextInBitmap(size_t from) const
+  {
+    size_t word = from >> 6;
+    if (word >= bitmap_.size()) return kIdSpace;
+    uint64_t bits = bitmap_[word] & (~uint64_t(0) << (from & 63));
+    while (!bits)
+    {
+      if (++word == bitmap_.size()) return kIdSpace;
+      bits = bitmap_[word];
+    }
+    return (word << 6) + detail::count_trailing_zeros(bits);
+  }
+
+  void toBitmap()
+  {
+    bitmap_.assign(kIdSpace / 64, 0);
+    for (auto id : sorted_)
+    {
+      bitmap_[id >> 6] |= uint64_t(1) << (id & 63);
+    }
+    sorted_.clear();
+    isBitmap_ = true;
+  }
+
+  void toSorted()
+  {
+    sorted_.clear();
+    for (size_t id = nextInBitmap(0); id < kIdSpace; id = nextInBitmap(id + 1))
+    {
+      sorted_.push_back(static_cast<uint16_t>(id));
+    }
+    isBitmap_ = false;
+  }
+
+  std::vector<uint16_t> sorted_;
+  std::vector<uint64_t> bitmap_; // only valid if isBitmap_
+  size_t size_;
+  bool isBitmap_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_ID_SET_H
@@ -0,0 +1,134 @@
+#include <bfcp/common/bfcp_mbuf_pool.h>
+
+#include <new>
+
+namespace bfcp
+{
+namespace detail
+{
+
+// max free blocks kept by each size class
+const size_t kMaxFreeBufs[MBufPool::kSizeClassNum] = { 1024, 256, 16 };
+
+} // namespace detail
+
+// NOTE: mbuf must be the first member,
+// so the mbuf pointer is also the pointer of the mem object
+struct MBufPool::PooledMBuf
+{
+  mbuf_t mb;
+  SizeClass sizeClass;
+  MBufPoolPtr pool;
+};
+
+MBufPool::MBufPool()
+{
+}
+
+MBufPool::~MBufPool()
+{
+  for (auto &freeBufs : freeBufs_)
+  {
+    for (auto buf : freeBufs)
+    {
+      mem_deref(buf);
+    }
+  }
+}
+
+size_t MBufPool::getSizeOfClass(SizeClass sizeClass)
+{
+  static const size_t kSizes[kSizeClassNum] =
+    { kSmallSize, kMediumSize, kLargeSize };
+  return kSizes[sizeClass];
+}
+
+mbuf_t* MBufPool::alloc(size_t size)
+{
+  if (size > kLargeSize)
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    ++stats_.misses;
+    return mbuf_alloc(size);
+  }
+
+  SizeClass sizeClass = kSmall;
+  while (getSizeOfClass(sizeClass) < size)
+  {
+    sizeClass = static_cast<SizeClass>(sizeClass + 1);
+  }
+  size_t classSize = getSizeOfClass(sizeClass);
+
+  PooledMBuf *pmb = static_cast<PooledMBuf*>(
+    mem_zalloc(sizeof(PooledMBuf), &MBufPool::destroyPooledMBuf));
+  if (!pmb) return nullptr;
+
+  uint8_t *buf = nullptr;
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    auto &freeBufs = freeBufs_[sizeClass];
+    if (!freeBufs.empty())
+    {
+      buf = freeBufs.back();
+      freeBufs.pop_back();
+      stats_.bytesHeld -= classSize;
+      ++stats_.hits;
+    }
+    else
+    {
+      ++stats_.misses;
+    }
+  }
+  if (!buf)
+  {
+    buf = static_cast<uint8_t*>(mem_alloc(classSize, nullptr));
+  }
+
+  new (&pmb->pool) MBufPoolPtr(shared_from_this());
+  pmb->sizeClass = sizeClass;
+  pmb->mb.buf = buf;
+  pmb->mb.size = buf ? classSize : 0;
+  if (!buf)
+  {
+    mem_deref(pmb);
+    return nullptr;
+  }
+  return &pmb->mb;
+}
+
+MBufPool::Stats MBufPool::getStats() const
+{
+  muduo::MutexLockGuard lock(mutex_);
+  return stats_;
+}
+
+void MBufPool::destroyPooledMBuf(void *data)
+{
+  PooledMBuf *pmb = static_cast<PooledMBuf*>(data);
+  MBufPoolPtr pool;
+  pool.swap(pmb->pool);
+  pmb->pool.~MBufPoolPtr();
+  if (pmb->mb.buf)
+  {
+    pool->release(pmb->sizeClass, pmb->mb.buf, pmb->mb.size);
+  }
+}
+
+void MBufPool::release(SizeClass sizeClass, uint8_t *buf, size_t size)
+{
+  // the mbuf may be resized by libre when written more than its space
+  if (size == getSizeOfClass(sizeClass))
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    auto &freeBufs = freeBufs_[sizeClass];
+    if (freeBufs.size() < detail::kMaxFreeBufs[sizeClass])
+    {
+      freeBufs.push_back(buf);
+      stats_.bytesHeld += size;
+      return;
+    }
+  }
+  mem_deref(buf);
+}
+
+} // namespace bfcp
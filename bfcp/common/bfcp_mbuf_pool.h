@@ -0,0 +1,74 @@
+#ifndef BFCP_MBUF_POOL_H
+#define BFCP_MBUF_POOL_H
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <muduo/base/Mutex.h>
+
+#include <bfcp/common/bfcp_ex.h>
+
+namespace bfcp
+{
+
+class MBufPool;
+typedef boost::shared_ptr<MBufPool> MBufPoolPtr;
+
+// Pool of mbuf data blocks with size classes.
+// The mbuf returned by alloc is a normal libre mbuf released by mem_deref,
+// its data block goes back to the pool instead of the heap.
+// NOTE: must be created by boost::make_shared,
+// the pooled mbufs keep the pool alive.
+class MBufPool : public boost::enable_shared_from_this<MBufPool>,
+                 boost::noncopyable
+{
+public:
+  enum SizeClass
+  {
+    kSmall = 0,
+    kMedium,
+    kLarge,
+    kSizeClassNum,
+  };
+
+  static const size_t kSmallSize = 256;
+  static const size_t kMediumSize = 1536;
+  static const size_t kLargeSize = 65536;
+
+  typedef struct Stats
+  {
+    Stats() : hits(0), misses(0), bytesHeld(0) {}
+
+    uint64_t hits;
+    uint64_t misses;
+    size_t bytesHeld; // bytes of free blocks held by the pool
+  } Stats;
+
+  MBufPool();
+  ~MBufPool();
+
+  // return a mbuf with at least size bytes space,
+  // the mbuf still grows by itself if more space is written.
+  mbuf_t* alloc(size_t size);
+
+  Stats getStats() const;
+
+  static size_t getSizeOfClass(SizeClass sizeClass);
+
+private:
+  struct PooledMBuf;
+
+  static void destroyPooledMBuf(void *data);
+  void release(SizeClass sizeClass, uint8_t *buf, size_t size);
+
+  mutable muduo::MutexLock mutex_;
+  std::vector<uint8_t*> freeBufs_[kSizeClassNum];
+  Stats stats_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_MBUF_POOL_H
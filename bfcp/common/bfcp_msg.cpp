@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <muduo/base/Logging.h>
 
+#include <bfcp/common/bfcp_msg_decode.h>
+
 using muduo::net::Buffer;
 using muduo::net::InetAddress;
 using muduo::strerror_tl;
@@ -27,12 +29,10 @@ BfcpMsg::BfcpMsg(muduo::net::Buffer *buf,
                  muduo::Timestamp receivedTime)
    : msg_(nullptr), receivedTime_(receivedTime)
 {
-  mbuf_t mb;
-  mbuf_init(&mb);
-  mb.buf = reinterpret_cast<uint8_t*>(const_cast<char*>(buf->peek()));
-  mb.size = buf->readableBytes();
-  mb.end = mb.size;
-  err_ = bfcp_msg_decode(&msg_, &mb);
+  if (!decodeInPlace(buf))
+  {
+    decode(buf);
+  }
   buf->retrieveAll();
 
   if (err_ == 0)
@@ -45,6 +45,56 @@ BfcpMsg::BfcpMsg(muduo::net::Buffer *buf,
   }
 }
 
+void BfcpMsg::decode(muduo::net::Buffer *buf)
+{
+  mbuf_t mb;
+  mbuf_init(&mb);
+  mb.buf = reinterpret_cast<uint8_t*>(const_cast<char*>(buf->peek()));
+  mb.size = buf->readableBytes();
+  mb.end = mb.size;
+  err_ = bfcp_msg_decode(&msg_, &mb);
+}
+
+bool BfcpMsg::decodeInPlace(muduo::net::Buffer *buf)
+{
+  // the fragments are merged by libre, decode them as before
+  if (buf->readableBytes() > 0 && (buf->peek()[0] & 0x08))
+    return false;
+
+  bufNode_ = BfcpBufPoolSingleton::instance().tryGetFreeBufNode();
+  if (!bufNode_)
+    return false;
+
+  // take over the received data, 
+  // and leave the empty buffer of the node to the receiver
+  muduo::net::Buffer &data = bufNode_->buf;
+  data.retrieveAll();
+  data.swap(*buf);
+  // one more byte to terminate the last string attribute
+  data.ensureWritableBytes(1);
+  int err = decode_msg_in_place(
+    &msg_,
+    reinterpret_cast<uint8_t*>(const_cast<char*>(data.peek())),
+    data.readableBytes());
+  if (err != 0)
+  {
+    // let libre report the error
+    data.swap(*buf);
+    releaseBufNode();
+    return false;
+  }
+  err_ = 0;
+  return true;
+}
+
+void BfcpMsg::releaseBufNode()
+{
+  if (bufNode_)
+  {
+    BfcpBufPoolSingleton::instance().releaseBufNode(bufNode_);
+  }
+}
+
 std::list<BfcpAttr> BfcpMsg::getAttributes() const
 {
   std::list<BfcpAttr> attrs;
@@ -13,6 +13,7 @@
 
 #include <bfcp/common/bfcp_ex.h>
 #include <bfcp/common/bfcp_attr.h>
+#include <bfcp/common/bfcp_buf_pool.h>
 
 namespace bfcp
 {
@@ -84,6 +85,8 @@ public:
       isComplete_(true)
   {}
 
+  // NOTE: the non-fragmented msg takes over the data of buf 
+  // and its attributes point into the data if a free buf node is available
   BfcpMsg(muduo::net::Buffer *buf, 
           const muduo::net::InetAddress &src, 
           muduo::Timestamp receivedTime);
@@ -91,6 +94,7 @@ public:
   ~BfcpMsg() { 
     mem_deref(msg_); 
     msg_ = nullptr;
+    releaseBufNode();
   }
 
   bool valid() const { return err_ == 0; }
@@ -151,11 +155,15 @@ private:
     msg_->src.len = rawAddr.len;
   }
   void doAddFragment(const BfcpMsg *msg);
+  void decode(muduo::net::Buffer *buf);
+  bool decodeInPlace(muduo::net::Buffer *buf);
+  void releaseBufNode();
 
 private:
   typedef std::set<Fragment> FragmentSet;
 
   ::bfcp_msg_t *msg_;
+  BfcpBufNodePtr bufNode_; // holds the data if decoded in place
   int err_;
   muduo::Timestamp receivedTime_;
  
@@ -1,8 +1,11 @@
 #include <bfcp/common/bfcp_msg_build.h>
 
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 
+#include <boost/noncopyable.hpp>
+
 namespace bfcp
 {
 namespace detail
@@ -521,7 +524,8 @@ int build_msg_GoodbyeAck( mbuf_t *buf, uint8_t version, const bfcp_entity &entit
     0);
 }
 
-int build_msg_fragments( std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, size_t maxMsgSize )
+int build_msg_fragments( std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, 
+                         size_t maxMsgSize, MBufPool *pool )
 {
   assert(kHeaderWithFragSize < maxMsgSize);
 
@@ -552,7 +556,7 @@ int build_msg_fragments( std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, size_t
     size_t remainPayloadSize = payloadSize;
     for (size_t i = 0; i < fragmentCount; ++i)
     {
-      mbuf_t *buf = mbuf_alloc(maxMsgSize);
+      mbuf_t *buf = pool ? pool->alloc(maxMsgSize) : mbuf_alloc(maxMsgSize);
       if (!buf)
       {
         err = ENOMEM;
@@ -588,4 +592,474 @@ int build_msg_fragments( std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, size_t
   return err;
 }
 
+namespace detail
+{
+
+const size_t kAttrHeaderSize = 2;
+// BENEFICIARY-ID, FLOOR-ID, PRIORITY, REQUEST-STATUS, 
+// and the header with ID of grouped attributes
+const size_t kAttrWithU16Size = 4;
+
+inline size_t padded_size(size_t len)
+{
+  return (len + 3) & ~static_cast<size_t>(0x3);
+}
+
+// NOTE: the sizes must be the same as what libre bfcp_attrs_encode does,
+// the empty string is not encoded like the null value in libre
+
+inline size_t get_attr_size_string(const string &str)
+{
+  return str.empty() ? 0 : padded_size(kAttrHeaderSize + str.size());
+}
+
+// BENEFICIARY-INFORMATION and REQUESTED-BY-INFORMATION
+inline size_t get_attr_size_USER_INFORMATION(const UserInfoParam &user)
+{
+  return kAttrWithU16Size + 
+         get_attr_size_string(user.username) + 
+         get_attr_size_string(user.useruri);
+}
+
+// FLOOR-REQUEST-STATUS and OVERALL-REQUEST-STATUS
+inline size_t get_attr_size_REQUEST_STATUS_INFO(bool hasRequestStatus, 
+                                                const string &statusInfo)
+{
+  return kAttrWithU16Size + 
+         (hasRequestStatus ? kAttrWithU16Size : 0) + 
+         get_attr_size_string(statusInfo);
+}
+
+size_t get_attr_size_FLOOR_REQUEST_INFORMATION(const FloorRequestInfoParam &frqInfo)
+{
+  size_t size = kAttrWithU16Size;
+  if (frqInfo.valueType & kHasOverallRequestStatus)
+  {
+    size += get_attr_size_REQUEST_STATUS_INFO(
+      frqInfo.oRS.hasRequestStatus, frqInfo.oRS.statusInfo);
+  }
+  for (auto &floorRequestStatus : frqInfo.fRS)
+  {
+    size += get_attr_size_REQUEST_STATUS_INFO(
+      floorRequestStatus.hasRequestStatus, floorRequestStatus.statusInfo);
+  }
+  if (frqInfo.valueType & kHasBeneficiaryInfo)
+  {
+    size += get_attr_size_USER_INFORMATION(frqInfo.beneficiary);
+  }
+  if (frqInfo.valueType & kHasRequestedByInfo)
+  {
+    size += get_attr_size_USER_INFORMATION(frqInfo.requestedBy);
+  }
+  size += kAttrWithU16Size; // priority
+  size += get_attr_size_string(frqInfo.partPriovidedInfo);
+  return size;
+}
+
+// Write the msg with known payload size into right-sized bufs,
+// start a new fragment when the current one is full.
+class MsgWriter : boost::noncopyable
+{
+public:
+  MsgWriter(std::vector<mbuf_t*> &msgBufs, 
+            const bfcp_hdr_t &header, 
+            size_t maxMsgSize, 
+            MBufPool *pool)
+      : msgBufs_(msgBufs),
+        header_(header),
+        payloadSize_(header.len * 4),
+        maxFragPayloadSize_(0),
+        writtenSize_(0),
+        remainSize_(0),
+        buf_(nullptr),
+        pool_(pool),
+        err_(0)
+  {
+    assert(kHeaderWithFragSize < maxMsgSize);
+    if (kHeaderSize + payloadSize_ >= maxMsgSize)
+    {
+      maxFragPayloadSize_ = (maxMsgSize - kHeaderWithFragSize) & ~0x3;
+    }
+    nextBuf();
+  }
+
+  ~MsgWriter()
+  {
+    for (auto buf : bufs_)
+    {
+      mem_deref(buf);
+    }
+  }
+
+  void writeU8(uint8_t v) { write(&v, 1); }
+
+  void writeU16(uint16_t v)
+  {
+    uint8_t data[2] = 
+      { static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v & 0xff) };
+    write(data, sizeof data);
+  }
+
+  void writeString(const string &str) { write(str.data(), str.size()); }
+
+  void writePadding(size_t len)
+  {
+    static const uint8_t kZeros[4] = { 0, 0, 0, 0 };
+    assert(len < sizeof kZeros);
+    write(kZeros, len);
+  }
+
+  int finish()
+  {
+    if (!err_ && (writtenSize_ != payloadSize_ || remainSize_ != 0))
+    {
+      // the precomputed size mismatches the written one
+      err_ = EINVAL;
+    }
+    if (!err_)
+    {
+      for (auto buf : bufs_)
+      {
+        buf->pos = 0;
+      }
+      msgBufs_.insert(msgBufs_.end(), bufs_.begin(), bufs_.end());
+      bufs_.clear();
+    }
+    return err_;
+  }
+
+private:
+  void write(const void *data, size_t len)
+  {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    while (len > 0 && !err_)
+    {
+      if (remainSize_ == 0 && !nextBuf()) break;
+      size_t n = (std::min)(len, remainSize_);
+      err_ = mbuf_write_mem(buf_, p, n);
+      p += n;
+      len -= n;
+      remainSize_ -= n;
+      writtenSize_ += n;
+    }
+  }
+
+  bool nextBuf()
+  {
+    if (!bufs_.empty() && writtenSize_ >= payloadSize_)
+    {
+      err_ = EOVERFLOW;
+      return false;
+    }
+
+    size_t remainPayloadSize = payloadSize_ - writtenSize_;
+    size_t bufSize = 0;
+    if (maxFragPayloadSize_ == 0)
+    {
+      header_.f = 0;
+      remainSize_ = remainPayloadSize;
+      bufSize = kHeaderSize + remainSize_;
+    }
+    else
+    {
+      remainSize_ = (std::min)(maxFragPayloadSize_, remainPayloadSize);
+      header_.f = 1;
+      header_.fragoffset = static_cast<uint16_t>(writtenSize_ / 4);
+      header_.fraglen = static_cast<uint16_t>(remainSize_ / 4);
+      bufSize = kHeaderWithFragSize + remainSize_;
+    }
+
+    buf_ = pool_ ? pool_->alloc(bufSize) : mbuf_alloc(bufSize);
+    if (!buf_)
+    {
+      err_ = ENOMEM;
+      return false;
+    }
+    bufs_.push_back(buf_);
+    err_ = bfcp_hdr_encode(buf_, &header_);
+    return !err_;
+  }
+
+  std::vector<mbuf_t*> &msgBufs_;
+  std::vector<mbuf_t*> bufs_;
+  bfcp_hdr_t header_;
+  const size_t payloadSize_;
+  size_t maxFragPayloadSize_; // 0 if the msg is not fragmented
+  size_t writtenSize_;
+  size_t remainSize_; // remain payload space of the current buf
+  mbuf_t *buf_;
+  MBufPool *pool_;
+  int err_;
+};
+
+inline void write_attr_header(MsgWriter &writer, int type, size_t len)
+{
+  // Type(7)|M(1)|Length(8), the length excludes the padding
+  writer.writeU8(static_cast<uint8_t>(
+    ((type & 0x7f) << 1) | ((type & BFCP_MANDATORY) ? 1 : 0)));
+  writer.writeU8(static_cast<uint8_t>(len));
+}
+
+inline void write_attr_u16(MsgWriter &writer, int type, uint16_t value)
+{
+  write_attr_header(writer, type, kAttrWithU16Size);
+  writer.writeU16(value);
+}
+
+inline void write_attr_string(MsgWriter &writer, int type, const string &str)
+{
+  if (str.empty()) return;
+  size_t len = kAttrHeaderSize + str.size();
+  write_attr_header(writer, type, len);
+  writer.writeString(str);
+  writer.writePadding(padded_size(len) - len);
+}
+
+inline void write_attr_PRIORITY(MsgWriter &writer, bfcp_priority priority)
+{
+  write_attr_header(writer, BFCP_PRIORITY | BFCP_MANDATORY, kAttrWithU16Size);
+  writer.writeU8(static_cast<uint8_t>(priority << 5));
+  writer.writeU8(0);
+}
+
+inline void write_attr_REQUEST_STATUS(MsgWriter &writer, const bfcp_reqstatus_t &rs)
+{
+  write_attr_header(writer, BFCP_REQUEST_STATUS, kAttrWithU16Size);
+  writer.writeU8(static_cast<uint8_t>(rs.status));
+  writer.writeU8(rs.qpos);
+}
+
+inline void write_attr_USER_INFORMATION(MsgWriter &writer, int type, 
+                                        const UserInfoParam &user)
+{
+  write_attr_header(writer, type, get_attr_size_USER_INFORMATION(user));
+  writer.writeU16(user.id);
+  write_attr_string(writer, BFCP_USER_DISP_NAME, user.username);
+  write_attr_string(writer, BFCP_USER_URI, user.useruri);
+}
+
+inline void write_attr_REQUEST_STATUS_INFO(MsgWriter &writer, int type, 
+                                           uint16_t id,
+                                           bool hasRequestStatus,
+                                           const bfcp_reqstatus_t &rs,
+                                           const string &statusInfo)
+{
+  write_attr_header(writer, type, 
+    get_attr_size_REQUEST_STATUS_INFO(hasRequestStatus, statusInfo));
+  writer.writeU16(id);
+  if (hasRequestStatus)
+  {
+    write_attr_REQUEST_STATUS(writer, rs);
+  }
+  write_attr_string(writer, BFCP_STATUS_INFO, statusInfo);
+}
+
+void write_attr_FLOOR_REQUEST_INFORMATION(MsgWriter &writer, 
+                                          const FloorRequestInfoParam &frqInfo)
+{
+  write_attr_header(writer, BFCP_FLOOR_REQ_INFO | BFCP_MANDATORY, 
+    get_attr_size_FLOOR_REQUEST_INFORMATION(frqInfo));
+  writer.writeU16(frqInfo.floorRequestID);
+
+  if (frqInfo.valueType & kHasOverallRequestStatus)
+  {
+    const OverallRequestStatusParam &oRS = frqInfo.oRS;
+    write_attr_REQUEST_STATUS_INFO(writer, 
+      BFCP_OVERALL_REQ_STATUS | BFCP_MANDATORY, oRS.floorRequestID, 
+      oRS.hasRequestStatus, oRS.requestStatus, oRS.statusInfo);
+  }
+
+  for (auto &fRS : frqInfo.fRS)
+  {
+    write_attr_REQUEST_STATUS_INFO(writer, 
+      BFCP_FLOOR_REQ_STATUS | BFCP_MANDATORY, fRS.floorID, 
+      fRS.hasRequestStatus, fRS.requestStatus, fRS.statusInfo);
+  }
+
+  if (frqInfo.valueType & kHasBeneficiaryInfo)
+  {
+    write_attr_USER_INFORMATION(writer, 
+      BFCP_BENEFICIARY_INFO | BFCP_MANDATORY, frqInfo.beneficiary);
+  }
+
+  if (frqInfo.valueType & kHasRequestedByInfo)
+  {
+    write_attr_USER_INFORMATION(writer, 
+      BFCP_REQUESTED_BY_INFO, frqInfo.requestedBy);
+  }
+
+  // NOTE: priority is optional
+  write_attr_PRIORITY(writer, frqInfo.priority);
+  write_attr_string(writer, BFCP_PART_PROV_INFO, frqInfo.partPriovidedInfo);
+}
+
+template <typename WritePayloadFunc>
+int encode_msg(std::vector<mbuf_t*> &msgBufs, 
+               size_t maxMsgSize, MBufPool *pool,
+               bool response, bfcp_prim primitive,
+               uint8_t version, const bfcp_entity &entity,
+               size_t payloadSize,
+               WritePayloadFunc writePayload)
+{
+  assert((payloadSize & 0x3) == 0);
+  bfcp_hdr_t header;
+  memset(&header, 0, sizeof header);
+  header.ver = version;
+  header.r = response ? 1 : 0;
+  header.prim = primitive;
+  header.len = static_cast<uint16_t>(payloadSize / 4);
+  header.confid = entity.conferenceID;
+  header.tid = entity.transactionID;
+  header.userid = entity.userID;
+
+  MsgWriter writer(msgBufs, header, maxMsgSize, pool);
+  writePayload(writer);
+  return writer.finish();
+}
+
+} // namespace detail
+
+size_t get_msg_size_FloorRequestStatus(const FloorRequestInfoParam &frqInfo)
+{
+  return kHeaderSize + get_attr_size_FLOOR_REQUEST_INFORMATION(frqInfo);
+}
+
+size_t get_msg_size_UserStatus(const UserStatusParam &userStatus)
+{
+  size_t size = kHeaderSize;
+  if (userStatus.hasBeneficiary)
+  {
+    size += get_attr_size_USER_INFORMATION(userStatus.beneficiary);
+  }
+  for (auto &floorRequestInfo : userStatus.frqInfoList)
+  {
+    size += get_attr_size_FLOOR_REQUEST_INFORMATION(floorRequestInfo);
+  }
+  return size;
+}
+
+size_t get_msg_size_FloorStatus(const FloorStatusParam &floorStatus)
+{
+  size_t size = kHeaderSize;
+  if (floorStatus.hasFloorID)
+  {
+    size += kAttrWithU16Size;
+  }
+  for (auto &floorRequestInfo : floorStatus.frqInfoList)
+  {
+    size += get_attr_size_FLOOR_REQUEST_INFORMATION(floorRequestInfo);
+  }
+  return size;
+}
+
+int encode_msg_FloorRequestStatus(std::vector<mbuf_t*> &msgBufs, 
+                                  size_t maxMsgSize, MBufPool *pool,
+                                  bool response, uint8_t version, 
+                                  const bfcp_entity &entity,
+                                  const FloorRequestInfoParam &frqInfo)
+{
+  return encode_msg(msgBufs, maxMsgSize, pool,
+    response, BFCP_FLOOR_REQUEST_STATUS, version, entity,
+    get_msg_size_FloorRequestStatus(frqInfo) - kHeaderSize,
+    [&frqInfo](MsgWriter &writer) {
+      write_attr_FLOOR_REQUEST_INFORMATION(writer, frqInfo);
+    });
+}
+
+int encode_msg_UserStatus(std::vector<mbuf_t*> &msgBufs, 
+                          size_t maxMsgSize, MBufPool *pool,
+                          uint8_t version, const bfcp_entity &entity,
+                          const UserStatusParam &userStatus)
+{
+  return encode_msg(msgBufs, maxMsgSize, pool,
+    true, BFCP_USER_STATUS, version, entity,
+    get_msg_size_UserStatus(userStatus) - kHeaderSize,
+    [&userStatus](MsgWriter &writer) {
+      if (userStatus.hasBeneficiary)
+      {
+        write_attr_USER_INFORMATION(writer, 
+          BFCP_BENEFICIARY_INFO | BFCP_MANDATORY, userStatus.beneficiary);
+      }
+      for (auto &floorRequestInfo : userStatus.frqInfoList)
+      {
+        write_attr_FLOOR_REQUEST_INFORMATION(writer, floorRequestInfo);
+      }
+    });
+}
+
+int encode_msg_FloorStatus(std::vector<mbuf_t*> &msgBufs, 
+                           size_t maxMsgSize, MBufPool *pool,
+                           bool response, uint8_t version, 
+                           const bfcp_entity &entity,
+                           const FloorStatusParam &floorStatus)
+{
+  return encode_msg(msgBufs, maxMsgSize, pool,
+    response, BFCP_FLOOR_STATUS, version, entity,
+    get_msg_size_FloorStatus(floorStatus) - kHeaderSize,
+    [&floorStatus](MsgWriter &writer) {
+      if (floorStatus.hasFloorID)
+      {
+        write_attr_u16(writer, BFCP_FLOOR_ID | BFCP_MANDATORY, floorStatus.floorID);
+      }
+      for (auto &floorRequestInfo : floorStatus.frqInfoList)
+      {
+        write_attr_FLOOR_REQUEST_INFORMATION(writer, floorRequestInfo);
+      }
+    });
+}
+
+int copy_msg_with_entity(std::vector<mbuf_t*> &msgBufs, 
+                         const std::vector<mbuf_t*> &encodedBufs,
+                         const bfcp_entity &entity,
+                         MBufPool *pool)
+{
+  // offsets in the common header (with or without fragment fields)
+  static const size_t kConferenceIDOffset = 4;
+  static const size_t kTransactionIDOffset = 8;
+  static const size_t kUserIDOffset = 10;
+
+  std::vector<mbuf_t*> bufs;
+  bufs.reserve(encodedBufs.size());
+  int err = 0;
+  for (auto encodedBuf : encodedBufs)
+  {
+    assert(encodedBuf->end >= kHeaderSize);
+    mbuf_t *buf = pool ? pool->alloc(encodedBuf->end) : mbuf_alloc(encodedBuf->end);
+    if (!buf)
+    {
+      err = ENOMEM;
+      break;
+    }
+    bufs.push_back(buf);
+    err = mbuf_write_mem(buf, encodedBuf->buf, encodedBuf->end);
+    if (err) break;
+
+    uint8_t *p = buf->buf + kConferenceIDOffset;
+    p[0] = static_cast<uint8_t>(entity.conferenceID >> 24);
+    p[1] = static_cast<uint8_t>(entity.conferenceID >> 16);
+    p[2] = static_cast<uint8_t>(entity.conferenceID >> 8);
+    p[3] = static_cast<uint8_t>(entity.conferenceID);
+    p = buf->buf + kTransactionIDOffset;
+    p[0] = static_cast<uint8_t>(entity.transactionID >> 8);
+    p[1] = static_cast<uint8_t>(entity.transactionID);
+    p = buf->buf + kUserIDOffset;
+    p[0] = static_cast<uint8_t>(entity.userID >> 8);
+    p[1] = static_cast<uint8_t>(entity.userID);
+    buf->pos = 0;
+  }
+
+  if (err)
+  {
+    for (auto buf : bufs)
+    {
+      mem_deref(buf);
+    }
+  }
+  else
+  {
+    msgBufs.insert(msgBufs.end(), bufs.begin(), bufs.end());
+  }
+  return err;
+}
+
 } // namespace bfcp
\ No newline at end of file
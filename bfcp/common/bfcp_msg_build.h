@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <bfcp/common/bfcp_ex.h>
+#include <bfcp/common/bfcp_mbuf_pool.h>
 #include <bfcp/common/bfcp_param.h>
 
 namespace bfcp
@@ -52,7 +53,43 @@ int build_msg_FloorStatusAck(mbuf_t *buf, uint8_t version, const bfcp_entity &en
 int build_msg_Goodbye(mbuf_t *buf, uint8_t version, const bfcp_entity &entity);
 int build_msg_GoodbyeAck(mbuf_t *buf, uint8_t version, const bfcp_entity &entity);
 
-int build_msg_fragments(std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, size_t maxMsgSize);
+// the fragment bufs are allocated from pool if it is not null
+int build_msg_fragments(std::vector<mbuf_t*> &fragBufs, mbuf_t *msgBuf, 
+                        size_t maxMsgSize, MBufPool *pool = nullptr);
+
+// Encoders which compute the exact msg size from the params first, 
+// then write the msg once into right-sized bufs allocated from pool 
+// (or the heap if pool is null). The msg is written into fragments directly
+// if it is not less than maxMsgSize, like build_msg_fragments.
+// On success, the bufs are appended to msgBufs and must be released by mem_deref.
+
+size_t get_msg_size_FloorRequestStatus(const FloorRequestInfoParam &frqInfo);
+size_t get_msg_size_UserStatus(const UserStatusParam &userStatus);
+size_t get_msg_size_FloorStatus(const FloorStatusParam &floorStatus);
+
+int encode_msg_FloorRequestStatus(std::vector<mbuf_t*> &msgBufs, 
+                                  size_t maxMsgSize, MBufPool *pool,
+                                  bool response, uint8_t version, 
+                                  const bfcp_entity &entity,
+                                  const FloorRequestInfoParam &frqInfo);
+
+int encode_msg_UserStatus(std::vector<mbuf_t*> &msgBufs, 
+                          size_t maxMsgSize, MBufPool *pool,
+                          uint8_t version, const bfcp_entity &entity,
+                          const UserStatusParam &userStatus);
+
+int encode_msg_FloorStatus(std::vector<mbuf_t*> &msgBufs, 
+                           size_t maxMsgSize, MBufPool *pool,
+                           bool response, uint8_t version, 
+                           const bfcp_entity &entity,
+                           const FloorStatusParam &floorStatus);
+
+// Copy the encoded msg (or its fragments) into new bufs 
+// with the conferenceID, transactionID and userID in the header replaced.
+int copy_msg_with_entity(std::vector<mbuf_t*> &msgBufs, 
+                         const std::vector<mbuf_t*> &encodedBufs,
+                         const bfcp_entity &entity,
+                         MBufPool *pool = nullptr);
 
 } // namespace bfcp
 
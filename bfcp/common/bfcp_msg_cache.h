@@ -0,0 +1,176 @@
+#ifndef BFCP_MSG_CACHE_H
+#define BFCP_MSG_CACHE_H
+
+#include <deque>
+#include <limits>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+
+#include <bfcp/common/bfcp_ex.h>
+
+namespace bfcp
+{
+namespace detail
+{
+
+typedef struct bfcp_msg_entry
+{
+  bfcp_prim prim;
+  bfcp_entity entity;
+} bfcp_msg_entry;
+
+inline bool operator<(const bfcp_msg_entry &lhs, const bfcp_msg_entry &rhs)
+{
+  int r = compare(lhs.entity, rhs.entity);
+  if (r < 0) return true;
+  if (r == 0) return lhs.prim < rhs.prim;
+  return false;
+}
+
+inline bool operator==(const bfcp_msg_entry &lhs, const bfcp_msg_entry &rhs)
+{
+  return lhs.prim == rhs.prim && lhs.entity == rhs.entity;
+}
+
+struct bfcp_msg_entry_hash
+{
+  size_t operator()(const bfcp_msg_entry &entry) const
+  {
+    uint64_t key = toKey(entry.entity) ^ (uint64_t(entry.prim) << 56);
+    // the finalizer of MurmurHash3
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+};
+
+typedef bfcp_msg_entry bfcp_strans_entry;
+
+} // namespace detail
+
+// Cache of msgs indexed by (entity, primitive) with time based expiry.
+// The items are expired in insertion order after ttl ticks,
+// the oldest items are evicted if the cached bytes exceed the capacity.
+// NOTE: not thread safe
+template <typename T>
+class MsgCache : boost::noncopyable
+{
+public:
+  typedef detail::bfcp_msg_entry Entry;
+
+  explicit MsgCache(uint64_t ttlInTicks,
+                    size_t maxBytes = std::numeric_limits<size_t>::max())
+      : ttl_(ttlInTicks),
+        maxBytes_(maxBytes),
+        bytes_(0),
+        currentTick_(0),
+        nextSeq_(0)
+  {}
+
+  void setMaxBytes(size_t maxBytes) { maxBytes_ = maxBytes; evict(0); }
+  size_t getMaxBytes() const { return maxBytes_; }
+  size_t bytes() const { return bytes_; }
+  size_t size() const { return index_.size(); }
+
+  T* find(const Entry &entry)
+  {
+    auto it = index_.find(entry);
+    return it != index_.end() ? &(*it).second.value : nullptr;
+  }
+
+  // return false if the entry exists or the item is larger than the capacity
+  bool insert(const Entry &entry, const T &value, size_t bytes = 0)
+  {
+    if (bytes > maxBytes_ || index_.count(entry)) return false;
+    evict(bytes);
+    Item &item = index_[entry];
+    item.value = value;
+    item.bytes = bytes;
+    item.seq = nextSeq_;
+    order_.push_back(Record(entry, nextSeq_, currentTick_));
+    ++nextSeq_;
+    bytes_ += bytes;
+    return true;
+  }
+
+  void erase(const Entry &entry)
+  {
+    auto it = index_.find(entry);
+    if (it != index_.end())
+    {
+      // the record in order_ is skipped when popped
+      bytes_ -= (*it).second.bytes;
+      index_.erase(it);
+    }
+  }
+
+  // advance one tick, return the number of expired items
+  size_t tick()
+  {
+    ++currentTick_;
+    size_t expired = 0;
+    while (!order_.empty() && currentTick_ - order_.front().tick >= ttl_)
+    {
+      expired += popFront();
+    }
+    return expired;
+  }
+
+private:
+  typedef struct Item
+  {
+    T value;
+    size_t bytes;
+    uint64_t seq;
+  } Item;
+
+  typedef struct Record
+  {
+    Record(const Entry &e, uint64_t s, uint64_t t)
+        : entry(e), seq(s), tick(t)
+    {}
+
+    Entry entry;
+    uint64_t seq;
+    uint64_t tick;
+  } Record;
+
+  void evict(size_t bytes)
+  {
+    while (!order_.empty() && bytes_ + bytes > maxBytes_)
+    {
+      popFront();
+    }
+  }
+
+  // return 1 if an item is removed
+  size_t popFront()
+  {
+    const Record &record = order_.front();
+    size_t removed = 0;
+    auto it = index_.find(record.entry);
+    // the item may be erased or inserted again with the same entry
+    if (it != index_.end() && (*it).second.seq == record.seq)
+    {
+      bytes_ -= (*it).second.bytes;
+      index_.erase(it);
+      removed = 1;
+    }
+    order_.pop_front();
+    return removed;
+  }
+
+  uint64_t ttl_;
+  size_t maxBytes_;
+  size_t bytes_;
+  uint64_t currentTick_;
+  uint64_t nextSeq_;
+  std::unordered_map<Entry, Item, detail::bfcp_msg_entry_hash> index_;
+  std::deque<Record> order_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_MSG_CACHE_H
@@ -0,0 +1,303 @@
+#include <bfcp/common/bfcp_msg_decode.h>
+
+#include <cassert>
+#include <cstring>
+
+#include <boost/type_traits/alignment_of.hpp>
+
+namespace bfcp
+{
+namespace detail
+{
+
+const size_t kMsgHeaderSize = 12;
+const size_t kAttrHeaderSize = 2;
+const size_t kGroupedAttrHeaderSize = 4;
+
+static_assert(sizeof(bfcp_prim) == sizeof(bfcp_attrib),
+              "supported attrs and prims share the enum space");
+
+inline size_t padded_size(size_t len) { return (len + 3) & ~static_cast<size_t>(3); }
+
+inline uint16_t read_u16(const uint8_t *p)
+{
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t read_u32(const uint8_t *p)
+{
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline bool is_grouped_attr(int type)
+{
+  switch (type)
+  {
+    case BFCP_BENEFICIARY_INFO:
+    case BFCP_FLOOR_REQ_INFO:
+    case BFCP_REQUESTED_BY_INFO:
+    case BFCP_FLOOR_REQ_STATUS:
+    case BFCP_OVERALL_REQ_STATUS:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// check the attribute length of known type,
+// return false for the unknown type which is left to libre
+bool check_attr_len(int type, size_t len)
+{
+  switch (type)
+  {
+    case BFCP_BENEFICIARY_ID:
+    case BFCP_FLOOR_ID:
+    case BFCP_FLOOR_REQUEST_ID:
+    case BFCP_PRIORITY:
+    case BFCP_REQUEST_STATUS:
+      return len == 4;
+
+    case BFCP_ERROR_CODE:
+      return len >= 3;
+
+    case BFCP_ERROR_INFO:
+    case BFCP_PART_PROV_INFO:
+    case BFCP_STATUS_INFO:
+    case BFCP_USER_DISP_NAME:
+    case BFCP_USER_URI:
+    case BFCP_SUPPORTED_ATTRS:
+    case BFCP_SUPPORTED_PRIMS:
+      return true;
+
+    default:
+      return is_grouped_attr(type) && len >= kGroupedAttrHeaderSize;
+  }
+}
+
+typedef struct DecodeSpace
+{
+  DecodeSpace() : attrNum(0), enumNum(0) {}
+
+  size_t attrNum;
+  size_t enumNum; // elements of supported attributes and primitives
+} DecodeSpace;
+
+// first pass: validate the attributes and count the space to decode them
+bool count_attrs(const uint8_t *p, const uint8_t *end, DecodeSpace &space)
+{
+  while (p < end)
+  {
+    if (static_cast<size_t>(end - p) < kAttrHeaderSize) return false;
+    int type = p[0] >> 1;
+    size_t len = p[1];
+    if (len < kAttrHeaderSize || !check_attr_len(type, len)) return false;
+    if (padded_size(len) > static_cast<size_t>(end - p)) return false;
+
+    ++space.attrNum;
+    if (type == BFCP_SUPPORTED_ATTRS || type == BFCP_SUPPORTED_PRIMS)
+    {
+      space.enumNum += len - kAttrHeaderSize;
+    }
+    else if (is_grouped_attr(type) &&
+             !count_attrs(p + kGroupedAttrHeaderSize, p + len, space))
+    {
+      return false;
+    }
+    p += padded_size(len);
+  }
+  return true;
+}
+
+class AttrDecoder
+{
+public:
+  AttrDecoder(bfcp_attr_t *attrs, void *enums)
+      : nextAttr_(attrs),
+        nextEnum_(static_cast<uint8_t*>(enums)),
+        pendingTerm_(nullptr)
+  {}
+
+  // second pass: decode the validated attributes into attrl
+  void decode(uint8_t *p, const uint8_t *end, struct list *attrl)
+  {
+    while (p < end)
+    {
+      int type = p[0] >> 1;
+      bool mand = (p[0] & 1) != 0;
+      size_t len = p[1];
+      // the pending terminator may be the first byte of this attribute
+      terminate();
+
+      bfcp_attr_t *attr = nextAttr_++;
+      attr->type = static_cast<bfcp_attrib>(type);
+      attr->mand = mand;
+      decodeValue(attr, p, len);
+      list_append(attrl, &attr->le, attr);
+      p += padded_size(len);
+    }
+  }
+
+  void terminate()
+  {
+    if (pendingTerm_)
+    {
+      *pendingTerm_ = '\0';
+      pendingTerm_ = nullptr;
+    }
+  }
+
+private:
+  char* decodeString(uint8_t *p, size_t len)
+  {
+    // the byte after the string is the padding, or the first byte of
+    // the next attribute which is terminated after its header is read
+    pendingTerm_ = p + len;
+    return reinterpret_cast<char*>(p + kAttrHeaderSize);
+  }
+
+  void decodeValue(bfcp_attr_t *attr, uint8_t *p, size_t len)
+  {
+    const uint8_t *value = p + kAttrHeaderSize;
+    size_t valueLen = len - kAttrHeaderSize;
+    switch (attr->type)
+    {
+      case BFCP_BENEFICIARY_ID:
+        attr->v.beneficiaryid = read_u16(value);
+        break;
+      case BFCP_FLOOR_ID:
+        attr->v.floorid = read_u16(value);
+        break;
+      case BFCP_FLOOR_REQUEST_ID:
+        attr->v.floorreqid = read_u16(value);
+        break;
+      case BFCP_PRIORITY:
+        attr->v.priority = static_cast<bfcp_priority>(value[0] >> 5);
+        break;
+      case BFCP_REQUEST_STATUS:
+        attr->v.reqstatus.status = static_cast<bfcp_reqstat>(value[0]);
+        attr->v.reqstatus.qpos = value[1];
+        break;
+
+      case BFCP_ERROR_CODE:
+        attr->v.errcode.code = static_cast<bfcp_err>(value[0]);
+        attr->v.errcode.len = valueLen - 1;
+        attr->v.errcode.details =
+          valueLen > 1 ? const_cast<uint8_t*>(value + 1) : nullptr;
+        break;
+
+      case BFCP_ERROR_INFO:
+        attr->v.errinfo = decodeString(p, len);
+        break;
+      case BFCP_PART_PROV_INFO:
+        attr->v.partprovinfo = decodeString(p, len);
+        break;
+      case BFCP_STATUS_INFO:
+        attr->v.statusinfo = decodeString(p, len);
+        break;
+      case BFCP_USER_DISP_NAME:
+        attr->v.userdname = decodeString(p, len);
+        break;
+      case BFCP_USER_URI:
+        attr->v.useruri = decodeString(p, len);
+        break;
+
+      case BFCP_SUPPORTED_ATTRS:
+      {
+        bfcp_attrib *attrv = reinterpret_cast<bfcp_attrib*>(nextEnum_);
+        for (size_t i = 0; i < valueLen; ++i)
+          attrv[i] = static_cast<bfcp_attrib>(value[i] >> 1);
+        attr->v.supattr.attrv = attrv;
+        attr->v.supattr.attrc = valueLen;
+        nextEnum_ += valueLen * sizeof(bfcp_attrib);
+        break;
+      }
+      case BFCP_SUPPORTED_PRIMS:
+      {
+        bfcp_prim *primv = reinterpret_cast<bfcp_prim*>(nextEnum_);
+        for (size_t i = 0; i < valueLen; ++i)
+          primv[i] = static_cast<bfcp_prim>(value[i]);
+        attr->v.supprim.primv = primv;
+        attr->v.supprim.primc = valueLen;
+        nextEnum_ += valueLen * sizeof(bfcp_prim);
+        break;
+      }
+
+      case BFCP_BENEFICIARY_INFO:
+        attr->v.beneficiaryid = read_u16(value);
+        decode(p + kGroupedAttrHeaderSize, p + len, &attr->attrl);
+        break;
+      case BFCP_FLOOR_REQ_INFO:
+      case BFCP_OVERALL_REQ_STATUS:
+        attr->v.floorreqid = read_u16(value);
+        decode(p + kGroupedAttrHeaderSize, p + len, &attr->attrl);
+        break;
+      case BFCP_REQUESTED_BY_INFO:
+        attr->v.reqbyid = read_u16(value);
+        decode(p + kGroupedAttrHeaderSize, p + len, &attr->attrl);
+        break;
+      case BFCP_FLOOR_REQ_STATUS:
+        attr->v.floorid = read_u16(value);
+        decode(p + kGroupedAttrHeaderSize, p + len, &attr->attrl);
+        break;
+
+      default:
+        assert(false && "unknown attribute type");
+        break;
+    }
+  }
+
+  bfcp_attr_t *nextAttr_;
+  uint8_t *nextEnum_;
+  uint8_t *pendingTerm_;
+};
+
+} // namespace detail
+
+using namespace bfcp::detail;
+
+int decode_msg_in_place(bfcp_msg_t **msgp, uint8_t *data, size_t size)
+{
+  assert(msgp && data);
+  if (size < kMsgHeaderSize) return EBADMSG;
+
+  uint8_t ver = data[0] >> 5;
+  if (ver != BFCP_VER1 && ver != BFCP_VER2) return EBADMSG;
+  if (data[0] & 0x08) return ENOSYS;
+
+  size_t payloadSize = 4 * size_t(read_u16(data + 2));
+  if (size - kMsgHeaderSize < payloadSize) return EBADMSG;
+
+  uint8_t *payload = data + kMsgHeaderSize;
+  DecodeSpace space;
+  if (!count_attrs(payload, payload + payloadSize, space)) return EBADMSG;
+
+  // one mem object: msg | attributes | enums of supported attrs/prims
+  const size_t kAttrAlign = boost::alignment_of<bfcp_attr_t>::value;
+  size_t attrsOffset = (sizeof(bfcp_msg_t) + kAttrAlign - 1) & ~(kAttrAlign - 1);
+  size_t enumsOffset = attrsOffset + space.attrNum * sizeof(bfcp_attr_t);
+  size_t totalSize = enumsOffset + space.enumNum * sizeof(bfcp_attrib);
+  uint8_t *block = static_cast<uint8_t*>(mem_zalloc(totalSize, nullptr));
+  if (!block) return ENOMEM;
+
+  bfcp_msg_t *msg = reinterpret_cast<bfcp_msg_t*>(block);
+  msg->ver = ver;
+  msg->r = (data[0] >> 4) & 1;
+  msg->f = 0;
+  msg->prim = static_cast<bfcp_prim>(data[1]);
+  msg->len = read_u16(data + 2);
+  msg->confid = read_u32(data + 4);
+  msg->tid = read_u16(data + 8);
+  msg->userid = read_u16(data + 10);
+
+  AttrDecoder decoder(reinterpret_cast<bfcp_attr_t*>(block + attrsOffset),
+                      block + enumsOffset);
+  decoder.decode(payload, payload + payloadSize, &msg->attrl);
+  // the last terminator may be data[size]
+  decoder.terminate();
+
+  *msgp = msg;
+  return 0;
+}
+
+} // namespace bfcp
@@ -0,0 +1,21 @@
+#ifndef BFCP_MSG_DECODE_H
+#define BFCP_MSG_DECODE_H
+
+#include <bfcp/common/bfcp_ex.h>
+
+namespace bfcp
+{
+
+// Decode a non-fragmented msg without copying,
+// the strings and error details of the attributes point into data,
+// the msg and all its attributes are allocated as one mem object.
+// NOTE: data[size] must be writable, the strings are terminated in place,
+// data must outlive the decoded msg.
+// return ENOSYS if the msg is a fragment,
+// EBADMSG if the msg cannot be decoded in place, the caller should
+// decode it by bfcp_msg_decode instead. data is not modified on error.
+int decode_msg_in_place(bfcp_msg_t **msgp, uint8_t *data, size_t size);
+
+} // namespace bfcp
+
+#endif // BFCP_MSG_DECODE_H
@@ -0,0 +1,82 @@
+#include <bfcp/common/bfcp_timing_wheel.h>
+
+#include <cassert>
+#include <cmath>
+
+#include <bfcp/common/bfcp_ctrans.h>
+
+namespace bfcp
+{
+
+TimingWheel::TimingWheel(double tickInSec)
+    : tickInSec_(tickInSec),
+      currentTick_(0),
+      size_(0)
+{
+  assert(tickInSec_ > 0);
+}
+
+void TimingWheel::schedule(const ClientTransactionPtr &transaction, double delay)
+{
+  // NOTE: tolerate the rounding error of delay / tickInSec_, 
+  // e.g. (3 * 0.05) / 0.05 is not exactly 3
+  uint64_t ticks = static_cast<uint64_t>(std::ceil(delay / tickInSec_ - 1e-6));
+  if (ticks == 0) ticks = 1;
+  insert(Entry(transaction, currentTick_ + ticks));
+  ++size_;
+}
+
+void TimingWheel::insert(Entry &&entry)
+{
+  assert(entry.expiredTick > currentTick_);
+  uint64_t ticks = entry.expiredTick - currentTick_;
+  if (ticks < kSlotNum)
+  {
+    near_[entry.expiredTick & (kSlotNum - 1)].push_back(std::move(entry));
+  }
+  else
+  {
+    // the timeout beyond the far level is cascaded again
+    // until it falls into the near level
+    uint64_t farTick = entry.expiredTick >> kSlotBits;
+    if (ticks >= kSlotNum * kSlotNum)
+    {
+      farTick = (currentTick_ >> kSlotBits) + kSlotNum - 1;
+    }
+    far_[farTick & (kSlotNum - 1)].push_back(std::move(entry));
+  }
+}
+
+void TimingWheel::tick()
+{
+  ++currentTick_;
+  size_t index = currentTick_ & (kSlotNum - 1);
+  if (index == 0)
+  {
+    Slot cascaded;
+    cascaded.swap(far_[(currentTick_ >> kSlotBits) & (kSlotNum - 1)]);
+    for (auto &entry : cascaded)
+    {
+      if (entry.expiredTick <= currentTick_)
+        near_[index].push_back(std::move(entry));
+      else
+        insert(std::move(entry));
+    }
+  }
+
+  assert(expired_.empty());
+  expired_.swap(near_[index]);
+  size_ -= expired_.size();
+  // the transactions may be scheduled again in onSendTimeout
+  for (auto &entry : expired_)
+  {
+    ClientTransactionPtr transaction = entry.transaction.lock();
+    if (transaction)
+    {
+      transaction->onSendTimeout();
+    }
+  }
+  expired_.clear();
+}
+
+} // namespace bfcp
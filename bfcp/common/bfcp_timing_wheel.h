@@ -0,0 +1,67 @@
+#ifndef BFCP_TIMING_WHEEL_H
+#define BFCP_TIMING_WHEEL_H
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace bfcp
+{
+
+class ClientTransaction;
+typedef boost::shared_ptr<ClientTransaction> ClientTransactionPtr;
+
+// Hierarchical timing wheel driving the retransmissions of
+// client transactions, schedule and tick are O(1).
+// The first level has kSlotNum slots of one tick,
+// the second level has kSlotNum slots of kSlotNum ticks which are
+// cascaded into the first level when the first level wraps around.
+// NOTE: the transactions are held by weak_ptr, so there is no need to cancel,
+// the transaction destructed before timeout is dropped at its slot.
+// NOTE: not thread safe, used in the loop thread of BfcpConnection
+class TimingWheel : boost::noncopyable
+{
+public:
+  static const size_t kSlotBits = 6;
+  static const size_t kSlotNum = 1 << kSlotBits;
+
+  explicit TimingWheel(double tickInSec);
+
+  double getTickInSec() const { return tickInSec_; }
+  // number of scheduled timeouts, including the ones of destructed transactions
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // call ClientTransaction::onSendTimeout after delay seconds
+  void schedule(const ClientTransactionPtr &transaction, double delay);
+  // advance one tick and call the expired timeouts
+  void tick();
+
+private:
+  typedef struct Entry
+  {
+    Entry(const ClientTransactionPtr &ctran, uint64_t tick)
+        : transaction(ctran), expiredTick(tick)
+    {}
+
+    boost::weak_ptr<ClientTransaction> transaction;
+    uint64_t expiredTick;
+  } Entry;
+
+  typedef std::vector<Entry> Slot;
+
+  void insert(Entry &&entry);
+
+  double tickInSec_;
+  uint64_t currentTick_;
+  size_t size_;
+  Slot near_[kSlotNum];
+  Slot far_[kSlotNum];
+  Slot expired_; // reused to avoid allocation on each tick
+};
+
+} // namespace bfcp
+
+#endif // BFCP_TIMING_WHEEL_H
@@ -1,11 +1,15 @@
 #include <bfcp/server/base_server.h>
 
+#include <algorithm>
+
+#include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
 
 #include <bfcp/common/bfcp_buf_pool.h>
 #include <bfcp/common/bfcp_conn.h>
 #include <bfcp/server/thread_pool.h>
 #include <bfcp/server/conference.h>
+#include <bfcp/server/notification_queue.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -14,47 +18,190 @@ namespace bfcp
 {
 
 const double BaseServer::kDefaultUserObsoletedTime = 30;
+const size_t BaseServer::kDefaultNotificationWindow = 
+  NotificationQueue::kDefaultWindow;
+
+namespace detail
+{
+
+const char kServerName[] = "BfcpServer";
+
+// peek the conferenceID in the common header without decoding the msg,
+// return false if the datagram is too short to be a bfcp msg
+bool peekConferenceID(const Buffer *buf, uint32_t *conferenceID)
+{
+  // ver(3)|R|F|Res(3)|Primitive(8)|Payload Length(16)|Conference ID(32)
+  static const size_t kConferenceIDOffset = 4;
+  if (buf->readableBytes() < kConferenceIDOffset + sizeof(uint32_t))
+  {
+    return false;
+  }
+  const uint8_t *p = 
+    reinterpret_cast<const uint8_t*>(buf->peek()) + kConferenceIDOffset;
+  *conferenceID = (static_cast<uint32_t>(p[0]) << 24) |
+                  (static_cast<uint32_t>(p[1]) << 16) |
+                  (static_cast<uint32_t>(p[2]) << 8) |
+                  static_cast<uint32_t>(p[3]);
+  return true;
+}
+
+// the tasks of the msgs received, without the member function pointer
+// of a bind they stay well within Task::kInlineSize, so no allocation.
+// NOTE: the tasks run by the workers flush the notifications themselves
+class NewRequestTask
+{
+public:
+  NewRequestTask(const ConferencePtr &conference, const BfcpMsgPtr &msg)
+      : conference_(conference), msg_(msg)
+  {}
+
+  void operator()() 
+  { 
+    conference_->onNewRequest(msg_); 
+    conference_->flushNotifications();
+  }
+
+private:
+  ConferencePtr conference_;
+  BfcpMsgPtr msg_;
+};
+
+class ResponseTask
+{
+public:
+  ResponseTask(const ConferencePtr &conference,
+               bfcp_prim expectedPrimitive,
+               uint16_t userID,
+               uint32_t notificationID,
+               ResponseError err,
+               const BfcpMsgPtr &msg)
+      : conference_(conference), 
+        msg_(msg),
+        notificationID_(notificationID),
+        expectedPrimitive_(expectedPrimitive),
+        err_(err),
+        userID_(userID)
+  {}
+
+  void operator()()
+  { 
+    conference_->onResponse(
+      expectedPrimitive_, userID_, notificationID_, err_, msg_); 
+    conference_->flushNotifications();
+  }
+
+private:
+  ConferencePtr conference_;
+  BfcpMsgPtr msg_;
+  uint32_t notificationID_;
+  bfcp_prim expectedPrimitive_;
+  ResponseError err_;
+  uint16_t userID_;
+};
+
+class FloorRequestTimeoutTask
+{
+public:
+  typedef void (Conference::*Handler)(uint16_t);
+
+  FloorRequestTimeoutTask(const ConferencePtr &conference, 
+                          Handler handler, 
+                          uint16_t floorRequestID)
+      : conference_(conference), 
+        handler_(handler), 
+        floorRequestID_(floorRequestID)
+  {}
+
+  void operator()()
+  {
+    ((*conference_).*handler_)(floorRequestID_);
+    conference_->flushNotifications();
+  }
+
+private:
+  ConferencePtr conference_;
+  Handler handler_;
+  uint16_t floorRequestID_;
+};
+
+} // namespace detail
 
 BaseServer::BaseServer(muduo::net::EventLoop* loop, 
                        const muduo::net::InetAddress& listenAddr) 
    : loop_(CHECK_NOTNULL(loop)),
-     server_(loop, listenAddr, "BfcpServer", UdpServer::kReuseAddr),
-     connectionLoop_(loop),
+     listenAddr_(listenAddr),
+     connectionLoops_(1, loop),
+     connections_(1),
+     conferenceMaps_(1),
      numThreads_(0),
+     numConnectionLoops_(1),
      threadPool_(new ThreadPool("BfcpServerThreadPool")),
      enableConnectionThread_(false),
-     userObsoletedTime_(kDefaultUserObsoletedTime)
+     enableConferenceAffinity_(false),
+     userObsoletedTime_(kDefaultUserObsoletedTime),
+     notificationWindow_(kDefaultNotificationWindow),
+     maxCachedReplyBytes_(0)
 {
-  server_.setStartedRecvCallback(
-    boost::bind(&BaseServer::onStartedRecv, this, _1));
-  server_.setMessageCallback(
-    boost::bind(&BaseServer::onMessage, this, _1, _2, _3, _4));
-  server_.setWriteCompleteCallback(
-    boost::bind(&BaseServer::onWriteComplete, this, _1, _2));
 }
 
-void BaseServer::onStartedRecv( const muduo::net::UdpSocketPtr& socket )
+void BaseServer::createConnection(size_t index, 
+                                  const muduo::net::UdpSocketPtr& socket)
 {
-  LOG_TRACE << "Start receiving data at " << socket->getLocalAddr().toIpPort();
-  if (!connection_)
+  assert(index < connections_.size());
+  if (!connections_[index])
   {
-    connection_ = boost::make_shared<BfcpConnection>(connectionLoop_, socket);
-    connection_->setNewRequestCallback(
+    BfcpConnectionPtr connection = 
+      boost::make_shared<BfcpConnection>(connectionLoops_[index], socket);
+    connection->setNewRequestCallback(
       boost::bind(&BaseServer::onNewRequest, this, _1));
+    if (maxCachedReplyBytes_ > 0)
+    {
+      connection->setMaxCachedReplyBytes(maxCachedReplyBytes_);
+    }
+    connections_[index] = connection;
+    numStartedConnections_.increment();
   }
 }
 
-void BaseServer::onMessage( const UdpSocketPtr& socket, Buffer* buf, const InetAddress& src, Timestamp time )
+void BaseServer::onStartedRecv(size_t index, 
+                               const muduo::net::UdpSocketPtr& socket)
 {
-  LOG_TRACE << server_.name() << " recv " << buf->readableBytes() << " bytes at " << time.toString()
-            << " from " << src.toIpPort();
-  if (!connection_)
+  LOG_TRACE << "Start receiving data at " << socket->getLocalAddr().toIpPort();
+  createConnection(index, socket);
+}
+
+void BaseServer::onMessage(size_t index, 
+                           const UdpSocketPtr& socket, 
+                           Buffer* buf, 
+                           const InetAddress& src, 
+                           Timestamp time)
+{
+  LOG_TRACE << servers_[index].name() << " recv " << buf->readableBytes() 
+            << " bytes at " << time.toString() << " from " << src.toIpPort();
+  if (connections_.size() == 1)
   {
-    connection_ = boost::make_shared<BfcpConnection>(connectionLoop_, socket);
-    connection_->setNewRequestCallback(
-      boost::bind(&BaseServer::onNewRequest, this, _1));
+    createConnection(index, socket);
+    connections_[index]->onMessage(buf, src, time);
+    return;
+  }
+
+  // the kernel spreads datagrams over the sockets by the source address,
+  // so dispatch the msg to the connection which owns its conference
+  if (numStartedConnections_.get() != static_cast<int>(connections_.size()))
+  {
+    LOG_WARN << "Drop datagram from " << src.toIpPort()
+             << " before all connections started";
+    buf->retrieveAll();
+    return;
+  }
+  uint32_t conferenceID;
+  if (!detail::peekConferenceID(buf, &conferenceID))
+  {
+    // let the receiving connection report the malformed msg
+    connections_[index]->onMessage(buf, src, time);
+    return;
   }
-  connection_->onMessage(buf, src, time);
+  connections_[getConnectionIndex(conferenceID)]->onMessage(buf, src, time);
 }
 
 void BaseServer::onWriteComplete( const UdpSocketPtr& socket, int messageId )
@@ -69,19 +216,73 @@ void BaseServer::enableConnectionThread()
   enableConnectionThread_ = true;
 }
 
+void BaseServer::enableConferenceAffinity()
+{
+  // each conference is owned by one connection loop which receives its msgs,
+  // runs its tasks and timers and sends its msgs, 
+  // so the request->grant->notify path never leaves the loop thread
+  enableConferenceAffinity_ = true;
+}
+
+void BaseServer::setTaskDrainBudget(size_t maxTasks, double maxTimeInSec)
+{
+  threadPool_->setDrainBudget(maxTasks, maxTimeInSec);
+}
+
 void BaseServer::start()
 {
   if (started_.getAndSet(1) == 0)
   {
-    if (enableConnectionThread_)
+    assert(servers_.empty());
+    assert(connectionThreads_.empty());
+    size_t numLoops = static_cast<size_t>(std::max(numConnectionLoops_, 1));
+    connectionLoops_.clear();
+    connections_.assign(numLoops, BfcpConnectionPtr());
+    conferenceMaps_.resize(numLoops);
+    if (numLoops == 1)
+    {
+      EventLoop *connectionLoop = loop_;
+      if (enableConnectionThread_)
+      {
+        connectionThreads_.push_back(new EventLoopThread);
+        connectionLoop = connectionThreads_.back().startLoop();
+      }
+      connectionLoops_.push_back(connectionLoop);
+      servers_.push_back(new UdpServer(
+        loop_, listenAddr_, detail::kServerName, UdpServer::kReuseAddr));
+    }
+    else
     {
-      assert(!connection_);
-      connectionThread_.reset(new EventLoopThread);
-      connectionLoop_ = connectionThread_->startLoop();
+      for (size_t i = 0; i < numLoops; ++i)
+      {
+        char name[32];
+        snprintf(name, sizeof name, "%s%d", 
+                 detail::kServerName, static_cast<int>(i + 1));
+        connectionThreads_.push_back(new EventLoopThread);
+        EventLoop *ioLoop = connectionThreads_.back().startLoop();
+        connectionLoops_.push_back(ioLoop);
+        servers_.push_back(new UdpServer(
+          ioLoop, listenAddr_, name, UdpServer::kReusePort));
+      }
     }
+
+    for (size_t i = 0; i < servers_.size(); ++i)
+    {
+      servers_[i].setStartedRecvCallback(
+        boost::bind(&BaseServer::onStartedRecv, this, i, _1));
+      servers_[i].setMessageCallback(
+        boost::bind(&BaseServer::onMessage, this, i, _1, _2, _3, _4));
+      servers_[i].setWriteCompleteCallback(
+        boost::bind(&BaseServer::onWriteComplete, this, _1, _2));
+    }
+
     threadPool_->setThreadInitCallback(workerThreadInitCallback_);
-    threadPool_->start(numThreads_);
-    server_.start();
+    // conference tasks run in the owning connection loop, no worker needed
+    threadPool_->start(enableConferenceAffinity_ ? 0 : numThreads_);
+    for (auto &server : servers_)
+    {
+      server.start();
+    }
   }
 }
 
@@ -89,31 +290,63 @@ void BaseServer::stop()
 {
   if (started_.getAndSet(0) == 1)
   {
-    threadPool_->stop();
-    if (connection_)
-    {
-      connection_->stopCacheTimer();
-      connection_ = nullptr;
-    }
-    if (enableConnectionThread_)
+    // NOTE: stop receiving and dispatching first,
+    // the io loops may dispatch msgs to the connections of the other shards
+    for (auto &server : servers_)
     {
-      connectionThread_.reset(nullptr);
+      server.stop();
     }
-    server_.stop();
+    numStartedConnections_.getAndSet(0);
+    threadPool_->stop();
+    // the msgs being dispatched with the connections started are done
+    // after each loop has run once, then no loop touches another shard
+    runInConnectionLoopsAndWait(&BaseServer::syncConnectionLoop);
+    runInConnectionLoopsAndWait(&BaseServer::stopConnectionInLoop);
+    servers_.clear();
+    connectionThreads_.clear();
+  }
+}
+
+void BaseServer::syncConnectionLoop(size_t index, CountDownLatch *latch)
+{
+  connectionLoops_[index]->assertInLoopThread();
+  latch->countDown();
+}
+
+void BaseServer::stopConnectionInLoop(size_t index, CountDownLatch *latch)
+{
+  connectionLoops_[index]->assertInLoopThread();
+  if (connections_[index])
+  {
+    connections_[index]->stopCacheTimer();
+    connections_[index] = nullptr;
+  }
+  latch->countDown();
+}
+
+void BaseServer::runInConnectionLoopsAndWait(
+  void (BaseServer::*func)(size_t, CountDownLatch*))
+{
+  CountDownLatch latch(static_cast<int>(connectionLoops_.size()));
+  for (size_t i = 0; i < connectionLoops_.size(); ++i)
+  {
+    connectionLoops_[i]->runInLoop(boost::bind(func, this, i, &latch));
   }
+  latch.wait();
 }
 
 void BaseServer::addConference(uint32_t conferenceID, 
                                const ConferenceConfig &config, 
                                const ResultCallback &cb)
 {
-  if (connectionLoop_->isInLoopThread())
+  EventLoop *connectionLoop = getConnectionLoop(conferenceID);
+  if (connectionLoop->isInLoopThread())
   {
     addConferenceInLoop(conferenceID, config, cb);
   }
   else
   {
-    connectionLoop_->runInLoop(
+    connectionLoop->runInLoop(
       boost::bind(&BaseServer::addConferenceInLoop,
       this, conferenceID, config, cb));
   }
@@ -128,9 +361,10 @@ void BaseServer::addConferenceInLoop(uint32_t conferenceID,
             << ", policy: " << toString(config.acceptPolicy)
             << ", timeForChairAction: " << config.timeForChairAction 
             << "}}";
-  connectionLoop_->assertInLoopThread();
-  auto lb = conferenceMap_.lower_bound(conferenceID);
-  if (lb != conferenceMap_.end() && (*lb).first == conferenceID)
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto lb = conferenceMap.lower_bound(conferenceID);
+  if (lb != conferenceMap.end() && (*lb).first == conferenceID)
   {
     if (cb)
     {
@@ -145,11 +379,12 @@ void BaseServer::addConferenceInLoop(uint32_t conferenceID,
     conferenceConfig.acceptPolicy = config.acceptPolicy;
     conferenceConfig.timeForChairAction = config.timeForChairAction;
     conferenceConfig.userObsoletedTime = userObsoletedTime_;
+    conferenceConfig.notificationWindow = notificationWindow_;
 
     ConferencePtr newConference = 
       boost::make_shared<Conference>(
-      connectionLoop_, 
-      connection_,
+      getConnectionLoop(conferenceID), 
+      getConnection(conferenceID),
       conferenceID,
       conferenceConfig);
 
@@ -158,11 +393,18 @@ void BaseServer::addConferenceInLoop(uint32_t conferenceID,
     newConference->setHoldingTimeoutCallback(
       boost::bind(&BaseServer::onHoldingFloorsTimeout, this, _1, _2));
     newConference->setClientReponseCallback(
-      boost::bind(&BaseServer::onResponse, this, _1, _2, _3, _4, _5));
-    conferenceMap_.insert(lb, std::make_pair(conferenceID, newConference));
-    int res = threadPool_->createQueue(conferenceID, 0);
-    (void)(res);
-    assert(res == 0);
+      boost::bind(&BaseServer::onResponse, this, _1, _2, _3, _4, _5, _6));
+    if (enableConferenceAffinity_)
+    {
+      newConference->enableFlushNotificationsInLoop();
+    }
+    conferenceMap.insert(lb, std::make_pair(conferenceID, newConference));
+    if (!enableConferenceAffinity_)
+    {
+      int res = threadPool_->createQueue(conferenceID, 0);
+      (void)(res);
+      assert(res == 0);
+    }
     if (cb)
     {
       cb(ControlError::kNoError);
@@ -172,16 +414,18 @@ void BaseServer::addConferenceInLoop(uint32_t conferenceID,
 
 void BaseServer::removeConference(uint32_t conferenceID, const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::removeConferenceInLoop, conferenceID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::removeConferenceInLoop, conferenceID, cb);
 }
 
 void BaseServer::removeConferenceInLoop(uint32_t conferenceID, 
                                         const ResultCallback &cb)
 {
   LOG_TRACE << "Remove Conference " << conferenceID;
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end())
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end())
   {
     if (cb)
     {
@@ -191,8 +435,11 @@ void BaseServer::removeConferenceInLoop(uint32_t conferenceID,
   }
   else
   {
-    conferenceMap_.erase(it);
-    threadPool_->releaseQueue(conferenceID);
+    conferenceMap.erase(it);
+    if (!enableConferenceAffinity_)
+    {
+      threadPool_->releaseQueue(conferenceID);
+    }
     if (cb)
     {
       cb(ControlError::kNoError);
@@ -204,7 +451,8 @@ void BaseServer::modifyConference(uint32_t conferenceID,
                                   const ConferenceConfig &config, 
                                   const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::modifyConferenceInLoop, conferenceID, config, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::modifyConferenceInLoop, conferenceID, config, cb);
 }
 
 void BaseServer::modifyConferenceInLoop(uint32_t conferenceID, 
@@ -224,7 +472,8 @@ void BaseServer::addFloor(uint32_t conferenceID,
                           const FloorConfig &config, 
                           const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::addFloorInLoop, conferenceID, floorID, config, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::addFloorInLoop, conferenceID, floorID, config, cb);
 }
 
 void BaseServer::addFloorInLoop(uint32_t conferenceID, 
@@ -240,7 +489,8 @@ void BaseServer::removeFloor(uint32_t conferenceID,
                              uint16_t floorID, 
                              const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::removeFloorInLoop, conferenceID, floorID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::removeFloorInLoop, conferenceID, floorID, cb);
 }
 
 void BaseServer::removeFloorInLoop(uint32_t conferenceID, 
@@ -258,6 +508,7 @@ void BaseServer::modifyFloor(uint32_t conferenceID,
                              const ResultCallback &cb)
 {
   runInLoop(
+    getConnectionLoop(conferenceID),
     &BaseServer::modifyFloorInLoop, 
     conferenceID, floorID, config, cb);
 }
@@ -278,7 +529,8 @@ void BaseServer::addUser(uint32_t conferenceID,
                          const UserInfoParam &user,
                          const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::addUserInLoop, conferenceID, user, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::addUserInLoop, conferenceID, user, cb);
 }
 
 void BaseServer::addUserInLoop(uint32_t conferenceID, 
@@ -293,7 +545,8 @@ void BaseServer::removeUser(uint32_t conferenceID,
                             uint16_t userID, 
                             const ResultCallback &cb)
 {
-  runInLoop(&BaseServer::removeUserInLoop, conferenceID, userID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::removeUserInLoop, conferenceID, userID, cb);
 }
 
 void BaseServer::removeUserInLoop(uint32_t conferenceID, 
@@ -306,7 +559,8 @@ void BaseServer::removeUserInLoop(uint32_t conferenceID,
 
 void BaseServer::setChair( uint32_t conferenceID, uint16_t floorID, uint16_t userID, const ResultCallback &cb )
 {
-  runInLoop(&BaseServer::setChairInLoop, conferenceID, floorID, userID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::setChairInLoop, conferenceID, floorID, userID, cb);
 }
 
 void BaseServer::setChairInLoop( uint32_t conferenceID, uint16_t floorID, uint16_t userID, const ResultCallback &cb )
@@ -318,7 +572,8 @@ void BaseServer::setChairInLoop( uint32_t conferenceID, uint16_t floorID, uint16
 
 void BaseServer::removeChair( uint32_t conferenceID, uint16_t floorID, const ResultCallback &cb )
 {
-  runInLoop(&BaseServer::removeChairInLoop, conferenceID, floorID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::removeChairInLoop, conferenceID, floorID, cb);
 }
 
 void BaseServer::removeChairInLoop( uint32_t conferenceID, uint16_t floorID, const ResultCallback &cb )
@@ -330,35 +585,52 @@ void BaseServer::removeChairInLoop( uint32_t conferenceID, uint16_t floorID, con
 
 void BaseServer::getConferenceIDs( const ResultWithDataCallback &cb )
 {
-  runInLoop(&BaseServer::getConferenceIDsInLoop, cb);
+  runInLoop(connectionLoops_[0], 
+    &BaseServer::getConferenceIDsInLoop, 
+    static_cast<size_t>(0), ConferenceIDList(), cb);
 }
 
-void BaseServer::getConferenceIDsInLoop(const ResultWithDataCallback &cb)
+void BaseServer::getConferenceIDsInLoop(size_t index, 
+                                        const ConferenceIDList &conferenceIDs,
+                                        const ResultWithDataCallback &cb)
 {
-  LOG_TRACE << "Get conference IDs";
-  connectionLoop_->assertInLoopThread();
-  ConferenceIDList conferenceIDs;
-  conferenceIDs.reserve(conferenceMap_.size());
-  for (auto &conference : conferenceMap_)
+  LOG_TRACE << "Get conference IDs of connection loop " << index;
+  connectionLoops_[index]->assertInLoopThread();
+  const ConferenceMap &conferenceMap = conferenceMaps_[index];
+  ConferenceIDList ids;
+  ids.reserve(conferenceIDs.size() + conferenceMap.size());
+  ids.insert(ids.end(), conferenceIDs.begin(), conferenceIDs.end());
+  for (auto &conference : conferenceMap)
+  {
+    ids.push_back(conference.first);
+  }
+  if (index + 1 < connectionLoops_.size())
+  {
+    // gather the conference IDs owned by the next loop
+    runInLoop(connectionLoops_[index + 1], 
+      &BaseServer::getConferenceIDsInLoop, index + 1, ids, cb);
+  }
+  else
   {
-    conferenceIDs.push_back(conference.first);
+    cb(ControlError::kNoError, &ids);
   }
-  cb(ControlError::kNoError, &conferenceIDs);
 }
 
 void BaseServer::getConferenceInfo(uint32_t conferenceID, 
                                    const ResultWithDataCallback &cb)
 {
-  runInLoop(&BaseServer::getConferenceInfoInLoop, conferenceID, cb);
+  runInLoop(getConnectionLoop(conferenceID),
+    &BaseServer::getConferenceInfoInLoop, conferenceID, cb);
 }
 
 void BaseServer::getConferenceInfoInLoop(uint32_t conferenceID, 
                                          const ResultWithDataCallback &cb)
 {
   LOG_TRACE << "Get Information of Conference " << conferenceID;
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end())
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end())
   {
     if (cb)
     {
@@ -366,6 +638,14 @@ void BaseServer::getConferenceInfoInLoop(uint32_t conferenceID,
       cb(ControlError::kConferenceNotExist, nullptr);
     }
   }
+  else if (enableConferenceAffinity_)
+  {
+    auto res = (*it).second->getConferenceInfo();
+    if (cb)
+    {
+      cb(ControlError::kNoError, &res);
+    }
+  }
   else
   {
     auto task = boost::bind(&Conference::getConferenceInfo, (*it).second);
@@ -383,58 +663,47 @@ void BaseServer::getConferenceInfoInLoop(uint32_t conferenceID,
   }
 }
 
-template <typename Func, typename Arg1>
-void BaseServer::runInLoop( Func func, const Arg1 &arg1 )
-{
-  if (connectionLoop_->isInLoopThread())
-  {
-    (this->*func)(arg1);
-  }
-  else
-  {
-    connectionLoop_->runInLoop(
-      boost::bind(func, this, arg1));
-  }
-}
-
 template <typename Func, typename Arg1, typename Arg2>
-void BaseServer::runInLoop(Func func, const Arg1 &arg1, const Arg2 &arg2)
+void BaseServer::runInLoop(EventLoop *loop, 
+                           Func func, const Arg1 &arg1, const Arg2 &arg2)
 {
-  if (connectionLoop_->isInLoopThread())
+  if (loop->isInLoopThread())
   {
     (this->*func)(arg1, arg2);
   }
   else
   {
-    connectionLoop_->runInLoop(
+    loop->runInLoop(
       boost::bind(func, this, arg1, arg2));
   }
 }
 
 template <typename Func, typename Arg1, typename Arg2, typename Arg3>
-void BaseServer::runInLoop( Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3 )
+void BaseServer::runInLoop(EventLoop *loop, 
+                           Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3)
 {
-  if (connectionLoop_->isInLoopThread())
+  if (loop->isInLoopThread())
   {
     (this->*func)(arg1, arg2, arg3);
   }
   else
   {
-    connectionLoop_->runInLoop(
+    loop->runInLoop(
       boost::bind(func, this, arg1, arg2, arg3));
   }
 }
 
 template <typename Func, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-void BaseServer::runInLoop(Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3, const Arg4 &arg4)
+void BaseServer::runInLoop(EventLoop *loop, 
+                           Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3, const Arg4 &arg4)
 {
-  if (connectionLoop_->isInLoopThread())
+  if (loop->isInLoopThread())
   {
     (this->*func)(arg1, arg2, arg3, arg4);
   }
   else
   {
-    connectionLoop_->runInLoop(
+    loop->runInLoop(
       boost::bind(func, this, arg1, arg2, arg3, arg4));
   }
 }
@@ -445,22 +714,32 @@ void BaseServer::runTask(Func func,
                          const Arg1 &arg1, 
                          const ResultCallback &cb)
 {
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end())
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end())
   {
     if (cb)
     {
       cb(ControlError::kConferenceNotExist);
     }
   }
+  else if (enableConferenceAffinity_)
+  {
+    ControlError res = ((*it).second.get()->*func)(arg1);
+    if (cb)
+    {
+      cb(res);
+    }
+  }
   else
   {
     ConferenceTask task = 
       boost::bind(func, (*it).second, arg1);
     threadPool_->run(
       conferenceID, 
-      boost::bind(&BaseServer::wrapTaskAndCallback, this, task, cb),
+      boost::bind(&BaseServer::wrapTaskAndCallback, 
+        this, (*it).second, task, cb),
       ThreadPool::kHighPriority);
   }
 }
@@ -472,32 +751,56 @@ void BaseServer::runTask(Func func,
                          const Arg2 &arg2, 
                          const ResultCallback &cb)
 {
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end())
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end())
   {
     if (cb)
     {
       cb(ControlError::kConferenceNotExist);
     }
   }
+  else if (enableConferenceAffinity_)
+  {
+    ControlError res = ((*it).second.get()->*func)(arg1, arg2);
+    if (cb)
+    {
+      cb(res);
+    }
+  }
   else
   {
     ConferenceTask task = 
       boost::bind(func, (*it).second, arg1, arg2);
     threadPool_->run(
       conferenceID, 
-      boost::bind(&BaseServer::wrapTaskAndCallback, this, task, cb),
+      boost::bind(&BaseServer::wrapTaskAndCallback, 
+        this, (*it).second, task, cb),
       ThreadPool::kHighPriority);
   }
 }
 
+void BaseServer::wrapTaskAndCallback(const ConferencePtr &conference,
+                                     const ConferenceTask &task, 
+                                     const ResultCallback &cb)
+{
+  auto res = task();
+  conference->flushNotifications();
+  if (cb) 
+  {
+    cb(res);
+  }
+}
+
 void BaseServer::onNewRequest( const BfcpMsgPtr &msg )
 {
   LOG_TRACE << "BfcpServer received new request " << msg->toString();
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(msg->getConferenceID());
-  if (it == conferenceMap_.end()) // conference not found
+  uint32_t conferenceID = msg->getConferenceID();
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end()) // conference not found
   {
     LOG_WARN << "Received new request for not existed conference " 
              << msg->getConferenceID();
@@ -508,39 +811,57 @@ void BaseServer::onNewRequest( const BfcpMsgPtr &msg )
     snprintf(errorInfo, sizeof errorInfo, 
       "Conference %u does not exist", msg->getConferenceID());
     param.setErrorInfo(errorInfo);
-    connection_->replyWithError(msg, param);
+    getConnection(conferenceID)->replyWithError(msg, std::move(param));
+  }
+  else if (enableConferenceAffinity_)
+  {
+    (*it).second->onNewRequest(msg);
   }
   else // conference found
   {
     int res = threadPool_->run(
       msg->getConferenceID(), 
-      boost::bind(&Conference::onNewRequest, (*it).second, msg),
+      detail::NewRequestTask((*it).second, msg),
       ThreadPool::kNormalPriority);
+    if (res == ThreadPool::kQueueFull)
+    {
+      // NOTE: don't block the loop, the client retransmits the request
+      LOG_WARN << "Drop BFCP request " << msg->toString() 
+               << " for the task queue of Conference " << conferenceID 
+               << " is full";
+    }
     (void)(res);
-    assert(res == 0);
+    assert(res == 0 || res == ThreadPool::kQueueFull);
   }
 }
 
 void BaseServer::onResponse(uint32_t conferenceID, 
                             bfcp_prim expectedPrimitive, 
                             uint16_t userID,
+                            uint32_t notificationID,
                             ResponseError err, 
                             const BfcpMsgPtr &msg)
 {
   LOG_TRACE << "BfcpServer received response";
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end()) // conference not found
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end()) // conference not found
   {
     LOG_ERROR << "Conference " << conferenceID << " not found";
   }
+  else if (enableConferenceAffinity_)
+  {
+    (*it).second->onResponse(
+      expectedPrimitive, userID, notificationID, err, msg);
+  }
   else
   {
     int res = threadPool_->run(
       conferenceID,
-      boost::bind(&Conference::onResponse, 
-        (*it).second, expectedPrimitive, userID, err, msg),
-      ThreadPool::kNormalPriority);
+      detail::ResponseTask(
+        (*it).second, expectedPrimitive, userID, notificationID, err, msg),
+      ThreadPool::kHighPriority); // never dropped
     (void)(res);
     assert(res == 0);
   }
@@ -551,19 +872,24 @@ void BaseServer::onChairActionTimeout(uint32_t conferenceID,
 {
   LOG_TRACE << "Chair action timeout with {conferenceID:" << conferenceID
             << ", floorRequestID:" << floorRequestID << "}";
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end()) // conference not found
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end()) // conference not found
   {
     LOG_ERROR << "Conference " << conferenceID << " not found";
   }
+  else if (enableConferenceAffinity_)
+  {
+    (*it).second->onTimeoutForChairAction(floorRequestID);
+  }
   else
   {
     int res = threadPool_->run(
       conferenceID,
-      boost::bind(&Conference::onTimeoutForChairAction, 
-        (*it).second, floorRequestID),
-      ThreadPool::kNormalPriority);
+      detail::FloorRequestTimeoutTask((*it).second, 
+        &Conference::onTimeoutForChairAction, floorRequestID),
+      ThreadPool::kHighPriority); // never dropped
     (void)(res);
     assert(res == 0);
   }
@@ -574,18 +900,23 @@ void BaseServer::onHoldingFloorsTimeout(uint32_t conferenceID,
 {
   LOG_TRACE << "Holding Floor(s) timeout with {conferenceID:" << conferenceID
             << ", floorRequestID:" << floorRequestID << "}";
-  connectionLoop_->assertInLoopThread();
-  auto it = conferenceMap_.find(conferenceID);
-  if (it == conferenceMap_.end()) // conference not found
+  getConnectionLoop(conferenceID)->assertInLoopThread();
+  ConferenceMap &conferenceMap = getConferenceMap(conferenceID);
+  auto it = conferenceMap.find(conferenceID);
+  if (it == conferenceMap.end()) // conference not found
   {
     LOG_ERROR << "Conference " << conferenceID << " not found";
   }
+  else if (enableConferenceAffinity_)
+  {
+    (*it).second->onTimeoutForHoldingFloors(floorRequestID);
+  }
   else
   {
     int res = threadPool_->run(
       conferenceID,
-      boost::bind(&Conference::onTimeoutForHoldingFloors, 
-        (*it).second, floorRequestID),
+      detail::FloorRequestTimeoutTask((*it).second, 
+        &Conference::onTimeoutForHoldingFloors, floorRequestID),
       ThreadPool::kHighPriority);
     (void)(res);
     assert(res == 0);
@@ -2,10 +2,11 @@
 #define BFCP_BASE_SERVER_H
 
 #include <map>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/scoped_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 #include <muduo/base/Atomic.h>
 #include <muduo/net/UdpSocket.h>
@@ -18,11 +19,16 @@
 #include <bfcp/common/bfcp_callbacks.h>
 #include <bfcp/common/bfcp_param.h>
 #include <bfcp/server/conference_define.h>
+#include <bfcp/server/thread_pool.h>
+
+namespace muduo
+{
+class CountDownLatch;
+}
 
 namespace bfcp
 {
 class BfcpConnection;
-class ThreadPool;
 class Conference;
 typedef boost::shared_ptr<BfcpConnection> BfcpConnectionPtr;
 typedef boost::shared_ptr<Conference> ConferencePtr;
@@ -36,6 +42,7 @@ public:
   typedef std::vector<uint32_t> ConferenceIDList;
 
   static const double kDefaultUserObsoletedTime;
+  static const size_t kDefaultNotificationWindow;
 
   BaseServer(muduo::net::EventLoop* loop, 
              const muduo::net::InetAddress& listenAddr);
@@ -45,6 +52,18 @@ public:
   // NOTE: call before start
   void enableConnectionThread();
 
+  // NOTE: call before start
+  // numLoops > 1 binds numLoops UDP sockets to the listen address with 
+  // SO_REUSEPORT, each one received by its own loop thread and BfcpConnection.
+  // Conferences are sharded by conferenceID onto these loops, 
+  // enableConnectionThread is ignored in this mode.
+  void setConnectionLoopNum(int numLoops) { numConnectionLoops_ = numLoops; }
+
+  // NOTE: call before start
+  // run the conference tasks in the connection loop owning the conference 
+  // instead of the worker threads, setWorkerThreadNum is ignored in this mode.
+  void enableConferenceAffinity();
+
   void setWorkerThreadNum(int numThreads) { numThreads_ = numThreads; }
   
   void setWorkerThreadInitCallback(const WorkerThreadInitCallback &cb)
@@ -52,9 +71,29 @@ public:
   void setWorkerThreadInitCallback(WorkerThreadInitCallback &&cb)
   { workerThreadInitCallback_ = std::move(cb); }
 
+  // NOTE: call before start
+  // max tasks and time in seconds a worker spends on a conference
+  // before switching to another one, when maxTimeInSec < 0.0, unlimited
+  void setTaskDrainBudget(size_t maxTasks, double maxTimeInSec);
+
   void setUserObsoleteTime(double timeInSec) { userObsoletedTime_ = timeInSec; }
 
+  // max unacknowledged notifications of each user,
+  // applied to the conferences added later
+  void setNotificationWindow(size_t window) { notificationWindow_ = window; }
+
+  // NOTE: call before start
+  // capacity in bytes of the reply cache of each connection
+  void setMaxCachedReplyBytes(size_t maxBytes) { maxCachedReplyBytes_ = maxBytes; }
+
+  // counters of the worker threads running the conference tasks
+  // NOTE: call between start and stop, in any thread
+  ThreadPool::Stats getWorkerThreadStats() const 
+  { return threadPool_->getStats(); }
+
   void start();
+  // NOTE: waits for the connection loops, 
+  // they must be running unless it's called in their thread
   void stop();
 
   void addConference(
@@ -118,20 +157,41 @@ public:
  
 private:
   typedef boost::function<ControlError ()> ConferenceTask;
+  typedef std::map<uint32_t, ConferencePtr> ConferenceMap;
 
-  void onStartedRecv(const muduo::net::UdpSocketPtr& socket);
-  void onMessage(const muduo::net::UdpSocketPtr& socket, 
+  void onStartedRecv(size_t index, const muduo::net::UdpSocketPtr& socket);
+  void onMessage(size_t index,
+                 const muduo::net::UdpSocketPtr& socket, 
                  muduo::net::Buffer* buf, 
                  const muduo::net::InetAddress& src, 
                  muduo::Timestamp time);
   void onWriteComplete(const muduo::net::UdpSocketPtr& socket, int messageId);
 
+  void createConnection(size_t index, const muduo::net::UdpSocketPtr& socket);
+  void syncConnectionLoop(size_t index, muduo::CountDownLatch *latch);
+  void stopConnectionInLoop(size_t index, muduo::CountDownLatch *latch);
+  void runInConnectionLoopsAndWait(
+    void (BaseServer::*func)(size_t, muduo::CountDownLatch*));
+
+  size_t getConnectionIndex(uint32_t conferenceID) const
+  { return conferenceID % connectionLoops_.size(); }
+
+  muduo::net::EventLoop* getConnectionLoop(uint32_t conferenceID) const
+  { return connectionLoops_[getConnectionIndex(conferenceID)]; }
+
+  const BfcpConnectionPtr& getConnection(uint32_t conferenceID) const
+  { return connections_[getConnectionIndex(conferenceID)]; }
+
+  ConferenceMap& getConferenceMap(uint32_t conferenceID)
+  { return conferenceMaps_[getConnectionIndex(conferenceID)]; }
+
   void onNewRequest(const BfcpMsgPtr &msg);
 
   void onResponse(
     uint32_t conferenceID, 
     bfcp_prim expectedPrimitive, 
     uint16_t userID,
+    uint32_t notificationID,
     ResponseError err, 
     const BfcpMsgPtr &msg);
 
@@ -203,6 +263,8 @@ private:
     const ResultCallback &cb);
 
   void getConferenceIDsInLoop(
+    size_t index,
+    const ConferenceIDList &conferenceIDs,
     const ResultWithDataCallback &cb);
 
   void getConferenceInfoInLoop(
@@ -210,29 +272,23 @@ private:
       const ResultWithDataCallback &cb);
 
   void wrapTaskAndCallback(
+    const ConferencePtr &conference,
     const ConferenceTask &task, 
-    const ResultCallback &cb)
-  {
-    auto res = task();
-    if (cb) 
-    {
-      cb(res);
-    }
-  }
-
-  template <typename Func, typename Arg1>
-  void runInLoop(Func func, const Arg1 &arg1);
+    const ResultCallback &cb);
 
   template <typename Func, typename Arg1, typename Arg2>
   void runInLoop(
+    muduo::net::EventLoop *loop,
     Func func, const Arg1 &arg1, const Arg2 &arg2);
 
   template <typename Func, typename Arg1, typename Arg2, typename Arg3>
   void runInLoop(
+    muduo::net::EventLoop *loop,
     Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3);
 
   template <typename Func, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
   void runInLoop(
+    muduo::net::EventLoop *loop,
     Func func, const Arg1 &arg1, const Arg2 &arg2, const Arg3 &arg3, const Arg4 &arg4);
 
   template <typename Func, typename Arg1>
@@ -258,17 +314,25 @@ private:
 
 private:
   muduo::net::EventLoop* loop_;
-  muduo::net::UdpServer server_;
-  BfcpConnectionPtr connection_;
-  muduo::net::EventLoop *connectionLoop_;
-  boost::scoped_ptr<muduo::net::EventLoopThread> connectionThread_;
+  muduo::net::InetAddress listenAddr_;
+  // one server, connection loop, connection and conference map per shard,
+  // the conference map of a shard is only accessed in its connection loop
+  boost::ptr_vector<muduo::net::UdpServer> servers_;
+  std::vector<muduo::net::EventLoop*> connectionLoops_;
+  std::vector<BfcpConnectionPtr> connections_;
+  std::vector<ConferenceMap> conferenceMaps_;
+  boost::ptr_vector<muduo::net::EventLoopThread> connectionThreads_;
+  muduo::AtomicInt32 numStartedConnections_;
   WorkerThreadInitCallback workerThreadInitCallback_;
   int numThreads_;
+  int numConnectionLoops_;
   boost::shared_ptr<ThreadPool> threadPool_;
   muduo::AtomicInt32 started_;
-  std::map<uint32_t, ConferencePtr> conferenceMap_;
   bool enableConnectionThread_;
+  bool enableConferenceAffinity_;
   double userObsoletedTime_;
+  size_t notificationWindow_;
+  size_t maxCachedReplyBytes_;
 };
 
 } // namespace bfcp
@@ -15,22 +15,6 @@ namespace bfcp
 namespace detail
 {
 
-class FloorRequestCmp
-{
-public:
-  FloorRequestCmp(uint16_t floorRequestID)
-      : floorRequestID_(floorRequestID)
-  {}
-
-  bool operator()(const FloorRequestNodePtr &floorRequest)
-  {
-    return floorRequest->getFloorRequestID() == floorRequestID_;
-  }
-
-private:
-  uint16_t floorRequestID_;
-};
-
 const bfcp_prim SUPPORTED_PRIMS[] = 
 {
   BFCP_FLOOR_REQUEST,
@@ -101,7 +85,12 @@ Conference::Conference(muduo::net::EventLoop *loop,
       maxFloorRequest_(config.maxFloorRequest),
       timeForChairAction_(config.timeForChairAction),
       acceptPolicy_(config.acceptPolicy),
-      userObsoletedTime_(config.userObsoletedTime)
+      floorRequestPool_(boost::make_shared<FloorRequestPool>()),
+      accepted_(true), // only the accepted queue has queue positions
+      isFlushingNotificationsInLoop_(false),
+      notificationFlushQueued_(false),
+      userObsoletedTime_(config.userObsoletedTime),
+      notificationWindow_(config.notificationWindow)
 {
   LOG_TRACE << "Conference::Conference [" << conferenceID << "] constructing";
   assert(connection_);
@@ -211,10 +200,10 @@ ControlError Conference::addUser(const UserInfoParam &user)
   }
   else
   {
-    auto res = users_.emplace_hint(
-      lb,
-      user.id, 
-      boost::make_shared<User>(user.id, user.username, user.useruri));
+    auto newUser = 
+      boost::make_shared<User>(user.id, user.username, user.useruri);
+    newUser->setNotificationWindow(notificationWindow_);
+    auto res = users_.insert(lb, std::make_pair(user.id, newUser));
     // FIXME: check if insert success
     (void)(res);
   }
@@ -234,10 +223,7 @@ ControlError Conference::removeUser( uint16_t userID )
   }
 
   // remove floor query
-  for (auto floor : floors_)
-  {
-    floor.second->removeQueryUser(userID);
-  }
+  clearFloorQueryOfUser(userID);
 
   // checks if the user is chair of any floors
   for (auto floor : floors_)
@@ -252,6 +238,8 @@ ControlError Conference::removeUser( uint16_t userID )
   cancelFloorRequestsFromAcceptedByUserID(userID);
   releaseFloorRequestsFromGrantedByUserID(userID);
 
+  // the notifications need the info of the user
+  flushNotifications();
   users_.erase(userID);
 
   tryToGrantFloorRequestsWithAllFloors();
@@ -262,72 +250,47 @@ ControlError Conference::removeUser( uint16_t userID )
 
 void Conference::cancelFloorRequestsFromPendingByUserID(uint16_t userID)
 {
-  for (auto it = pending_.begin(); it != pending_.end();)
+  for (auto &floorRequest : pending_.findByUserID(userID))
   {
-    auto floorRequest = *it;
-    if (floorRequest->getUserID() == userID ||
-        (floorRequest->hasBeneficiary() && 
-         floorRequest->getBeneficiaryID() == userID))
-    {
-      LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
-               << " from Pending Queue in Conference " << conferenceID_;
-      it = pending_.erase(it);
-      loop_->cancel(floorRequest->getExpiredTimer()); // cancel the chair action timer
-      floorRequest->setOverallStatus(BFCP_CANCELLED);
-      floorRequest->removeQueryUser(userID);
-      revokeFloorsFromFloorRequest(floorRequest);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Pending Queue in Conference " << conferenceID_;
+    pending_.remove(floorRequest);
+    loop_->cancel(floorRequest->getExpiredTimer()); // cancel the chair action timer
+    floorRequest->setOverallStatus(BFCP_CANCELLED);
+    floorRequest->removeQueryUser(userID);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
 
 void Conference::cancelFloorRequestsFromAcceptedByUserID( uint16_t userID )
 {
-  for (auto it = accepted_.begin(); it != accepted_.end();)
+  for (auto &floorRequest : accepted_.findByUserID(userID))
   {
-    auto floorRequest = *it;
-    if (floorRequest->getUserID() == userID ||
-        (floorRequest->hasBeneficiary() && 
-         floorRequest->getBeneficiaryID() == userID))
-    {
-      LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
-               << " from Accepted Queue in Conference " << conferenceID_;
-      it = accepted_.erase(it);
-      floorRequest->setOverallStatus(BFCP_CANCELLED);
-      floorRequest->removeQueryUser(userID);
-      floorRequest->setQueuePosition(0);
-      revokeFloorsFromFloorRequest(floorRequest);
-      updateQueuePosition(accepted_);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Accepted Queue in Conference " << conferenceID_;
+    accepted_.remove(floorRequest);
+    floorRequest->setOverallStatus(BFCP_CANCELLED);
+    floorRequest->removeQueryUser(userID);
+    floorRequest->setQueuePosition(0);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
 void Conference::releaseFloorRequestsFromGrantedByUserID( uint16_t userID )
 {
-  for (auto it = granted_.begin(); it != granted_.end();)
+  for (auto &floorRequest : granted_.findByUserID(userID))
   {
-    auto floorRequest = *it;
-    if (floorRequest->getUserID() == userID ||
-        (floorRequest->hasBeneficiary() && 
-         floorRequest->getBeneficiaryID() == userID))
-    {
-      LOG_INFO << "Release FloorRequest " << floorRequest->getFloorRequestID()
-               << " from Granted Queue in Conference " << conferenceID_;
-      it = granted_.erase(it);
-      loop_->cancel(floorRequest->getExpiredTimer()); // cancel the holding timer
-      floorRequest->setOverallStatus(BFCP_RELEASED);
-      floorRequest->removeQueryUser(userID);
-      revokeFloorsFromFloorRequest(floorRequest);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Release FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Granted Queue in Conference " << conferenceID_;
+    granted_.remove(floorRequest);
+    loop_->cancel(floorRequest->getExpiredTimer()); // cancel the holding timer
+    floorRequest->setOverallStatus(BFCP_RELEASED);
+    floorRequest->removeQueryUser(userID);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
@@ -344,10 +307,11 @@ ControlError Conference::addFloor(uint16_t floorID, const FloorConfig &config)
   } 
   else
   {
-    auto res = floors_.emplace_hint(
+    auto res = floors_.insert(
       lb, 
-      floorID, 
-      boost::make_shared<Floor>(floorID, config.maxGrantedNum, config.maxHoldingTime));
+      std::make_pair(
+        floorID, 
+        boost::make_shared<Floor>(floorID, config.maxGrantedNum, config.maxHoldingTime)));
     // FIXME: check if insert success
     (void)(res);
   }
@@ -368,7 +332,15 @@ ControlError Conference::removeFloor( uint16_t floorID )
   cancelFloorRequestsFromPendingByFloorID(floorID);
   cancelFloorRequestsFromAcceptedByFloorID(floorID);
   releaseFloorRequestsFromGrantedByFloorID(floorID);
-  
+
+  for (auto userID : floor->getQueryUsers())
+  {
+    auto user = findUser(userID);
+    if (user) user->removeQueryFloor(floorID);
+  }
+
+  // the query users still get the last status of the floor
+  flushNotifications();
   floors_.erase(floorID);
 
   tryToGrantFloorRequestsWithAllFloors();
@@ -377,60 +349,41 @@ ControlError Conference::removeFloor( uint16_t floorID )
 
 void Conference::cancelFloorRequestsFromPendingByFloorID(uint16_t floorID)
 {
-  for (auto it = pending_.begin(); it != pending_.end();)
+  for (auto &floorRequest : pending_.findByFloorID(floorID))
   {
-    if ((*it)->findFloor(floorID))
-    {
-      LOG_INFO << "Cancel FloorRequest " << (*it)->getFloorRequestID()
-               << " from Pending Queue in Conference " << conferenceID_;
-      auto floorRequest = *it;
-      loop_->cancel(floorRequest->getExpiredTimer()); // cancel the chair action timer
-      floorRequest->setOverallStatus(BFCP_CANCELLED);
-      it = pending_.erase(it);
-      revokeFloorsFromFloorRequest(floorRequest);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Pending Queue in Conference " << conferenceID_;
+    loop_->cancel(floorRequest->getExpiredTimer()); // cancel the chair action timer
+    floorRequest->setOverallStatus(BFCP_CANCELLED);
+    pending_.remove(floorRequest);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
 void Conference::cancelFloorRequestsFromAcceptedByFloorID(uint16_t floorID)
 {
-  for (auto it = accepted_.begin(); it != accepted_.end();)
+  for (auto &floorRequest : accepted_.findByFloorID(floorID))
   {
-    if ((*it)->findFloor(floorID))
-    {
-      LOG_INFO << "Cancel FloorRequest " << (*it)->getFloorRequestID()
-               << " from Accepted Queue in Conference " << conferenceID_;
-      auto floorRequest = *it;
-      floorRequest->setOverallStatus(BFCP_CANCELLED);
-      it = accepted_.erase(it);
-      revokeFloorsFromFloorRequest(floorRequest);
-      updateQueuePosition(accepted_);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Cancel FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Accepted Queue in Conference " << conferenceID_;
+    floorRequest->setOverallStatus(BFCP_CANCELLED);
+    accepted_.remove(floorRequest);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
 void Conference::releaseFloorRequestsFromGrantedByFloorID(uint16_t floorID)
 {
-  for (auto it = granted_.begin(); it != granted_.end();)
+  for (auto &floorRequest : granted_.findByFloorID(floorID))
   {
-    if ((*it)->findFloor(floorID))
-    {
-      LOG_INFO << "Release FloorRequest " << (*it)->getFloorRequestID()
-               << " from Granted Queue in Conference " << conferenceID_;
-      auto floorRequest = *it;
-      floorRequest->setOverallStatus(BFCP_RELEASED);
-      it = granted_.erase(it);
-      revokeFloorsFromFloorRequest(floorRequest);
-      notifyFloorAndRequestInfo(floorRequest);
-      continue;
-    }
-    ++it;
+    LOG_INFO << "Release FloorRequest " << floorRequest->getFloorRequestID()
+             << " from Granted Queue in Conference " << conferenceID_;
+    floorRequest->setOverallStatus(BFCP_RELEASED);
+    granted_.remove(floorRequest);
+    revokeFloorsFromFloorRequest(floorRequest);
+    notifyFloorAndRequestInfo(floorRequest);
   }
 }
 
@@ -522,11 +475,11 @@ bool Conference::tryToAcceptFloorRequestsWithFloor(FloorPtr &floor)
   if (!floor) return false;
   uint16_t floorID = floor->getFloorID();
   bool hasAcceptFloor = false;
-  for (auto it = pending_.begin(); it != pending_.end();)
+  for (auto &floorRequest : pending_.findByFloorID(floorID))
   {
-    auto floorRequest = *it;
     auto floorNode = floorRequest->findFloor(floorID);
-    if (floorNode && floorNode->getStatus() != BFCP_ACCEPTED)
+    assert(floorNode);
+    if (floorNode->getStatus() != BFCP_ACCEPTED)
     {
       floorNode->setStatus(BFCP_ACCEPTED);
       floorNode->setStatusInfo(nullptr);
@@ -538,13 +491,11 @@ bool Conference::tryToAcceptFloorRequestsWithFloor(FloorPtr &floor)
       else // all floor status in the floor request is accepted
       {
         // remove the floor request from pending queue
-        it = pending_.erase(it);
+        pending_.remove(floorRequest);
         loop_->cancel(floorRequest->getExpiredTimer()); // cancel the chair action timer
         insertFloorRequestToAcceptedQueue(floorRequest);
-        continue;
       }
     }
-    ++it;
   }
   return hasAcceptFloor;
 }
@@ -570,7 +521,6 @@ void Conference::insertFloorRequestToAcceptedQueue(
   floorRequest->setOverallStatus(BFCP_ACCEPTED);
   floorRequest->setPrioriy(BFCP_PRIO_LOWEST);
   insertFloorRequestToQueue(accepted_, floorRequest);
-  updateQueuePosition(accepted_);
   notifyFloorAndRequestInfo(floorRequest);
 }
 
@@ -611,42 +561,15 @@ void Conference::insertFloorRequestToQueue(
 {
   // NOTE: The queue stores floor requests from low priority to high priority
   // If queue position is not 0, we set the one the chair stated
-  auto it = queue.begin();
-  if (floorRequest->getQueuePosition() != 0 && it != queue.end())
-  {
-    int pos = 1;
-    auto rit = queue.rbegin();
-    while (pos < floorRequest->getQueuePosition() && 
-           rit != queue.rend())
-    {
-      ++pos;
-      ++rit;
-    }
-    if (pos == floorRequest->getQueuePosition())
-    {
-      it = rit.base();
-    }
-    else
-    {
-      it = queue.begin();
-    }
-    floorRequest->setPrioriy(BFCP_PRIO_LOWEST);
-  }
+  uint8_t qpos = floorRequest->getQueuePosition();
   floorRequest->setQueuePosition(0);
-
-  while (it != queue.end() && (*it)->getPriority() < floorRequest->getPriority()) {
-    ++it;
+  if (qpos != 0 && !queue.empty())
+  {
+    queue.insert(floorRequest, qpos);
   }
-  queue.insert(it, floorRequest);
-}
-
-void Conference::updateQueuePosition( FloorRequestQueue &queue )
-{
-  // NOTE: queue position starts from 1
-  uint8_t qpos = 1;
-  for (auto it = queue.rbegin(); it != queue.rend(); ++it)
+  else
   {
-    (*it)->setQueuePosition(qpos++);
+    queue.insert(floorRequest);
   }
 }
 
@@ -654,7 +577,7 @@ void Conference::onTimeoutForHoldingFloors( uint16_t floorRequestID )
 {
   LOG_TRACE << "FloorRequest " << floorRequestID 
             << " is expired in Conference " << conferenceID_;
-  auto floorRequest = findFloorRequest(granted_, floorRequestID);
+  auto floorRequest = granted_.find(floorRequestID);
   if (!floorRequest) return;
 
   LOG_INFO << "Revoke FloorRequest " << floorRequestID
@@ -692,7 +615,8 @@ bool Conference::tryToGrantFloorRequestsWithFloor( FloorPtr &floor )
 
   bool hasGrantFloor = false;
   // NOTE: floor request store floor requests from low priority to high priority
-  for (auto it = accepted_.rbegin(); it != accepted_.rend();)
+  auto floorRequests = accepted_.findByFloorID(floor->getFloorID());
+  for (auto it = floorRequests.rbegin(); it != floorRequests.rend(); ++it)
   {
     if (!floor->isFreeToGrant()) break;
     if (tryToGrantFloor(*it, floor))
@@ -702,15 +626,12 @@ bool Conference::tryToGrantFloorRequestsWithFloor( FloorPtr &floor )
       {
         auto floorRequest = *it;
         // remove the floor request from accepted queue
-        it = FloorRequestQueue::reverse_iterator(
-          accepted_.erase(std::next(it).base()));
+        accepted_.remove(floorRequest);
 
         // move the floor request to granted queue
         insertFloorRequestToGrantedQueue(floorRequest);
-        continue;
       }
     }
-    ++it;
   }
   return hasGrantFloor;
 }
@@ -748,55 +669,189 @@ void Conference::notifyFloorAndRequestInfo(
 }
 
 void Conference::notifyWithFloorStatus( uint16_t floorID )
+{
+  changedFloors_.insert(floorID);
+  queueNotificationFlush();
+}
+
+void Conference::notifyWithFloorRequestStatus(
+  const FloorRequestNodePtr &floorRequest)
+{
+  if (changedFloorRequestIDs_.insert(floorRequest->getFloorRequestID()))
+  {
+    changedFloorRequests_.push_back(floorRequest);
+  }
+  queueNotificationFlush();
+}
+
+void Conference::queueNotificationFlush()
+{
+  // NOTE: the conference run by the workers is flushed by the task,
+  // the loop must not touch it
+  if (isFlushingNotificationsInLoop_ && !notificationFlushQueued_)
+  {
+    notificationFlushQueued_ = true;
+    loop_->queueInLoop(boost::bind(&Conference::flushNotificationsOf,
+      boost::weak_ptr<Conference>(shared_from_this())));
+  }
+}
+
+void Conference::flushNotificationsOf(
+  const boost::weak_ptr<Conference> &conference)
+{
+  auto strongConference = conference.lock();
+  if (strongConference)
+  {
+    strongConference->flushNotifications();
+  }
+}
+
+void Conference::flushNotifications()
+{
+  notificationFlushQueued_ = false;
+  // NOTE: sending doesn't mark anything as changed
+  for (auto floorID : changedFloors_)
+  {
+    sendFloorStatus(floorID);
+  }
+  changedFloors_.clear();
+
+  for (auto &floorRequest : changedFloorRequests_)
+  {
+    sendFloorRequestStatus(floorRequest);
+  }
+  changedFloorRequests_.clear();
+  changedFloorRequestIDs_.clear();
+}
+
+void Conference::sendFloorStatus( uint16_t floorID )
 {
   auto floor = findFloor(floorID);
   if (!floor) return;
-  BasicRequestParam basicParam;
-  basicParam.conferenceID = conferenceID_;
-  auto floorStatusParam = getFloorStatusParam(floorID);
   // make the chair of the floor to be notified
   if (floor->isAssigned())
   {
-    floor->addQueryUser(floor->getChairID());
+    addQueryUserToFloor(floor, floor->getChairID());
   }
+  // encoded once when the first available user found,
+  // then only the header is patched for each query user
+  EncodedMsgPtr encodedMsg;
   // notify all query users about the floor status
   for (auto userID : floor->getQueryUsers())
   {
     auto user = findUser(userID);
     if (user && isUserAvailable(user))
     {
-      basicParam.userID = userID;
-      basicParam.dst = user->getAddr();
-      assert(clientReponseCallback_);
-      basicParam.cb = boost::bind(clientReponseCallback_,
-        conferenceID_, BFCP_FLOOR_STATUS_ACK, userID, _1, _2);
-      user->runSendMessageTask(
-        boost::bind(&BfcpConnection::notifyFloorStatus,
-        connection_, basicParam, floorStatusParam));
+      if (!encodedMsg)
+      {
+        encodedMsg = connection_->encodeFloorStatus(
+          conferenceID_, getFloorStatusParam(floorID));
+        if (!encodedMsg) return;
+      }
+      pushNotification(user, NotificationQueue::kFloorStatus, floorID,
+        BFCP_FLOOR_STATUS_ACK, encodedMsg);
     }
   }
 }
 
-void Conference::notifyWithFloorRequestStatus(
+void Conference::sendFloorRequestStatus(
   const FloorRequestNodePtr &floorRequest)
 {
   const auto &queryUsers = floorRequest->getFloorRequestQueryUsers();
-  BasicRequestParam param;
-  param.conferenceID = conferenceID_;
-  auto frqInfo = floorRequest->toFloorRequestInfoParam(users_);
+  EncodedMsgPtr encodedMsg;
   for (auto userID : queryUsers)
   {
     auto user = findUser(userID);
     if (user && isUserAvailable(user))
     {
-      param.userID = userID;
-      param.dst = user->getAddr();
-      assert(clientReponseCallback_);
-      param.cb = boost::bind(clientReponseCallback_, 
-        conferenceID_, BFCP_FLOOR_REQ_STATUS_ACK, userID, _1, _2);
-      user->runSendMessageTask(
-        boost::bind(&BfcpConnection::notifyFloorRequestStatus, 
-        connection_, param, frqInfo));
+      if (!encodedMsg)
+      {
+        encodedMsg = connection_->encodeFloorRequestStatus(
+          conferenceID_, floorRequest->toFloorRequestInfoParam(users_));
+        if (!encodedMsg) return;
+      }
+      pushNotification(user, NotificationQueue::kFloorRequestStatus,
+        floorRequest->getFloorRequestID(), 
+        BFCP_FLOOR_REQ_STATUS_ACK, encodedMsg);
+    }
+  }
+}
+
+void Conference::sendNotification(uint16_t userID, 
+                                  bfcp_prim expectedPrimitive,
+                                  const EncodedMsgPtr &encodedMsg, 
+                                  uint32_t notificationID)
+{
+  // NOTE: the user is looked up when the notification is sent,
+  // the queued one is cleared when the user is removed
+  auto user = findUser(userID);
+  assert(user);
+  BasicRequestParam param;
+  param.conferenceID = conferenceID_;
+  param.userID = userID;
+  param.dst = user->getAddr();
+  assert(clientReponseCallback_);
+  param.cb = boost::bind(clientReponseCallback_, 
+    conferenceID_, expectedPrimitive, userID, notificationID, _1, _2);
+  connection_->notifyWithEncodedMsg(std::move(param), encodedMsg);
+}
+
+void Conference::pushNotification(const UserPtr &user,
+                                  NotificationQueue::Type type,
+                                  uint16_t id,
+                                  bfcp_prim expectedPrimitive,
+                                  const EncodedMsgPtr &encodedMsg)
+{
+  if (!user->hasRoomForSendMessageTask(type, id))
+  {
+    resyncNotifications(user);
+  }
+  user->runSendMessageTask(type, id,
+    boost::bind(&Conference::sendNotification, this, 
+    user->getUserID(), expectedPrimitive, encodedMsg, _1));
+}
+
+void Conference::resyncNotifications(const UserPtr &user)
+{
+  // NOTE: nothing is lost by clearing the queued ones,
+  // the FloorStatus of each floor the user queries carries 
+  // the current state of the floor requests with the floor, 
+  // a finished floor request is no longer listed in it.
+  // The in-flight ones are kept until they are acknowledged.
+  uint16_t userID = user->getUserID();
+  LOG_WARN << "Notification queue of User " << userID << " in Conference " 
+           << conferenceID_ << " is full, resync it with the current state";
+  user->clearQueuedSendMessageTasks();
+
+  for (auto &floor : floors_)
+  {
+    const FloorPtr &floorPtr = floor.second;
+    bool isQueried = floorPtr->getQueryUsers().contains(userID) ||
+      (floorPtr->isAssigned() && floorPtr->getChairID() == userID);
+    if (!isQueried) continue;
+
+    EncodedMsgPtr encodedMsg = connection_->encodeFloorStatus(
+      conferenceID_, getFloorStatusParam(floor.first));
+    if (!encodedMsg) continue;
+    user->runSendMessageTask(NotificationQueue::kFloorStatus, floor.first,
+      boost::bind(&Conference::sendNotification, this, 
+      userID, BFCP_FLOOR_STATUS_ACK, encodedMsg, _1));
+  }
+
+  const FloorRequestQueue *queues[] = { &pending_, &accepted_, &granted_ };
+  for (auto queue : queues)
+  {
+    for (auto &floorRequest : *queue)
+    {
+      if (!floorRequest->getFloorRequestQueryUsers().contains(userID)) continue;
+
+      EncodedMsgPtr encodedMsg = connection_->encodeFloorRequestStatus(
+        conferenceID_, floorRequest->toFloorRequestInfoParam(users_));
+      if (!encodedMsg) continue;
+      user->runSendMessageTask(NotificationQueue::kFloorRequestStatus,
+        floorRequest->getFloorRequestID(),
+        boost::bind(&Conference::sendNotification, this, 
+        userID, BFCP_FLOOR_REQ_STATUS_ACK, encodedMsg, _1));
     }
   }
 }
@@ -859,7 +914,7 @@ bool Conference::checkUnknownAttrs( const BfcpMsgPtr &msg )
 
     ErrorParam param;
     param.setErrorCode(errcode);
-    connection_->replyWithError(msg, param);
+    connection_->replyWithError(msg, std::move(param));
     return false;
   }
   return true;
@@ -886,7 +941,7 @@ void Conference::replyWithError(const BfcpMsgPtr &msg,
   ErrorParam param;
   param.errorCode.code = err;
   param.setErrorInfo(errInfo);
-  connection_->replyWithError(msg, param);
+  connection_->replyWithError(msg, std::move(param));
 }
 
 void Conference::handleHello( const BfcpMsgPtr &msg )
@@ -907,7 +962,7 @@ void Conference::handleHello( const BfcpMsgPtr &msg )
   param.attributes.assign(
     detail::SUPPORTED_ATTRS, detail::SUPPORTED_ATTRS + attrCount);
 
-  connection_->replyWithHelloAck(msg, param);
+  connection_->replyWithHelloAck(msg, std::move(param));
 }
 
 void Conference::handleGoodbye( const BfcpMsgPtr &msg )
@@ -942,7 +997,7 @@ void Conference::handleFloorRequest( const BfcpMsgPtr &msg )
   if (!checkFloorIDs(msg, param.floorIDs)) return;
 
   FloorRequestNodePtr newFloorRequest = 
-    boost::make_shared<FloorRequestNode>(
+    floorRequestPool_->create(
       nextFloorRequestID_++, msg->getUserID(), param);
 
   for (auto &floorNode : newFloorRequest->getFloorNodeList())
@@ -1103,9 +1158,8 @@ bool Conference::checkFloorID( const BfcpMsgPtr &msg, uint16_t floorID )
 void Conference::replyWithFloorRequestStatus(
   const BfcpMsgPtr &msg, FloorRequestNodePtr &floorRequest)
 {
-  FloorRequestInfoParam param = 
-    floorRequest->toFloorRequestInfoParam(users_);
-  connection_->replyWithFloorRequestStatus(msg, param);
+  connection_->replyWithFloorRequestStatus(
+    msg, floorRequest->toFloorRequestInfoParam(users_));
 }
 
 void Conference::setFloorRequestExpired(FloorRequestNodePtr &floorRequest,
@@ -1143,7 +1197,6 @@ bool Conference::tryToGrantFloorRequestWithAllFloors(
   if (hasGrantedFloor && floorRequest->isAllFloorStatus(BFCP_GRANTED))
   {
     accepted_.remove(floorRequest);
-    updateQueuePosition(accepted_);
     insertFloorRequestToGrantedQueue(floorRequest);
     return true;
   }
@@ -1154,7 +1207,7 @@ void Conference::onTimeoutForChairAction( uint16_t floorRequestID )
 {
   LOG_TRACE << "FloorRequest " << floorRequestID 
             << " is expired in Conference " << conferenceID_;
-  auto floorRequest = findFloorRequest(pending_, floorRequestID);
+  auto floorRequest = pending_.find(floorRequestID);
   if (!floorRequest) return;
 
   for (auto &floorNode : floorRequest->getFloorNodeList())
@@ -1239,7 +1292,6 @@ FloorRequestNodePtr Conference::removeFloorRequest(
              << " from Accepted Queue in Conference " << conferenceID_;
     floorRequest->setOverallStatus(BFCP_CANCELLED);
     floorRequest->setQueuePosition(0);
-    updateQueuePosition(accepted_);
     return floorRequest;
   }
 
@@ -1262,17 +1314,34 @@ FloorRequestNodePtr Conference::removeFloorRequest(
 FloorRequestNodePtr Conference::extractFloorRequestFromQueue(
   FloorRequestQueue &queue, uint16_t floorRequestID, uint16_t userID)
 {
-  auto it = std::find_if(queue.begin(), queue.end(), 
-    detail::FloorRequestCmp(floorRequestID));
-  if (it != queue.end() && (*it)->getUserID() == userID)
+  auto floorRequest = queue.find(floorRequestID);
+  if (floorRequest && floorRequest->getUserID() == userID)
   {
-    auto floorRequest = *it;
-    queue.erase(it);
+    queue.remove(floorRequest);
     return floorRequest;
   }
   return nullptr;
 }
 
+void Conference::addQueryUserToFloor(const FloorPtr &floor, uint16_t userID)
+{
+  floor->addQueryUser(userID);
+  auto user = findUser(userID);
+  if (user) user->addQueryFloor(floor->getFloorID());
+}
+
+void Conference::clearFloorQueryOfUser(uint16_t userID)
+{
+  auto user = findUser(userID);
+  if (!user) return;
+  for (auto floorID : user->getQueryFloors())
+  {
+    auto floor = findFloor(floorID);
+    if (floor) floor->removeQueryUser(userID);
+  }
+  user->clearQueryFloors();
+}
+
 bool Conference::revokeFloorsFromFloorRequest(FloorRequestNodePtr &floorRequest)
 {
   UserPtr beneficiaryUser = floorRequest->hasBeneficiary() ? 
@@ -1464,7 +1533,7 @@ void Conference::denyFloorRequest(
 FloorRequestNodePtr Conference::checkFloorRequestInPendingQueue(
   const BfcpMsgPtr &msg, uint16_t floorRequestID)
 {
-  auto floorRequest = findFloorRequest(pending_, floorRequestID);
+  auto floorRequest = pending_.find(floorRequestID);
   if (!floorRequest)
   {
     char errorInfo[128];
@@ -1477,14 +1546,6 @@ FloorRequestNodePtr Conference::checkFloorRequestInPendingQueue(
   return floorRequest;
 }
 
-FloorRequestNodePtr Conference::findFloorRequest(
-  FloorRequestQueue &queue, uint16_t floorRequestID)
-{
-  auto it = std::find_if(queue.begin(), queue.end(), 
-    detail::FloorRequestCmp(floorRequestID));
-  return it != queue.end() ? *it : nullptr;
-}
-
 bool Conference::checkFloorsInFloorRequest(
   const BfcpMsgPtr &msg, 
   FloorRequestNodePtr &floorRequest, 
@@ -1541,7 +1602,7 @@ void Conference::revokeFloorRequest(
 FloorRequestNodePtr Conference::checkFloorRequestInGrantedQueue( 
   const BfcpMsgPtr &msg, uint16_t floorRequestID)
 {
-  auto floorRequest = findFloorRequest(granted_, floorRequestID);
+  auto floorRequest = granted_.find(floorRequestID);
   if (!floorRequest)
   {
     char errorInfo[128];
@@ -1568,14 +1629,14 @@ void Conference::handleFloorRequestQuery( const BfcpMsgPtr &msg )
   uint16_t floorRequestID = floorRequestIDAttr.getFloorRequestID();
 
   // find floor request in pending, accepted and granted queue
-  auto floorRequest = findFloorRequest(pending_, floorRequestID);
+  auto floorRequest = pending_.find(floorRequestID);
   if (!floorRequest)
   {
-    floorRequest = findFloorRequest(accepted_, floorRequestID);
+    floorRequest = accepted_.find(floorRequestID);
   }
   if (!floorRequest)
   {
-    floorRequest = findFloorRequest(granted_, floorRequestID);
+    floorRequest = granted_.find(floorRequestID);
   }
 
   if (!floorRequest) // floor request not found
@@ -1632,7 +1693,7 @@ void Conference::handleUserQuery( const BfcpMsgPtr &msg )
   getFloorRequestInfoParamsByUserID(param.frqInfoList, userID, accepted_);
   getFloorRequestInfoParamsByUserID(param.frqInfoList, userID, pending_);
   
-  connection_->replyWithUserStatus(msg, param);
+  connection_->replyWithUserStatus(msg, std::move(param));
 }
 
 void Conference::getFloorRequestInfoParamsByUserID(
@@ -1640,13 +1701,10 @@ void Conference::getFloorRequestInfoParamsByUserID(
   uint16_t userID, 
   const FloorRequestQueue &queue) const
 {
-  for (auto it = queue.rbegin(); it != queue.rend(); ++it)
+  auto floorRequests = queue.findByUserID(userID);
+  for (auto it = floorRequests.rbegin(); it != floorRequests.rend(); ++it)
   {
-    if ((*it)->getUserID() == userID || 
-        ((*it)->hasBeneficiary() && (*it)->getBeneficiaryID() == userID))
-    { 
-      frqInfoList.push_back((*it)->toFloorRequestInfoParam(users_));
-    }
+    frqInfoList.push_back((*it)->toFloorRequestInfoParam(users_));
   }
 }
 
@@ -1656,10 +1714,7 @@ void Conference::handleFloorQuery( const BfcpMsgPtr &msg )
   uint16_t userID = msg->getUserID();
   auto floorIDs = msg->getFloorIDs();
   // first clear the floor query of the user
-  for (auto floor : floors_)
-  {
-    floor.second->removeQueryUser(userID);
-  }
+  clearFloorQueryOfUser(userID);
   // set the new floor query of the user
   uint16_t invalidFloorID = 0;
   bool hasInvalidFloor = false;
@@ -1671,7 +1726,7 @@ void Conference::handleFloorQuery( const BfcpMsgPtr &msg )
       LOG_INFO << "Add Query User " << msg->getUserID() 
                << " to Floor " << floorID
                << " in Conference " << conferenceID_;
-      floor->addQueryUser(userID);
+      addQueryUserToFloor(floor, userID);
     }
     else
     {
@@ -1708,12 +1763,8 @@ void Conference::handleFloorQuery( const BfcpMsgPtr &msg )
 
 void Conference::replyWithFloorStatus(const BfcpMsgPtr &msg, const uint16_t *floorID)
 {
-  FloorStatusParam param;
-  if (floorID)
-  {
-    param = getFloorStatusParam(*floorID);
-  }
-  connection_->replyWithFloorStatus(msg, param);
+  connection_->replyWithFloorStatus(
+    msg, floorID ? getFloorStatusParam(*floorID) : FloorStatusParam());
 }
 
 void Conference::notifyWithFloorStatus(uint16_t userID, uint16_t floorID)
@@ -1721,15 +1772,11 @@ void Conference::notifyWithFloorStatus(uint16_t userID, uint16_t floorID)
   auto user = findUser(userID);
   if (user && isUserAvailable(user))
   {
-    BasicRequestParam basicParam;
-    basicParam.conferenceID = conferenceID_;
-    basicParam.userID = user->getUserID();
-    basicParam.dst = user->getAddr();
-    assert(clientReponseCallback_);
-    basicParam.cb = boost::bind(clientReponseCallback_, 
-      conferenceID_, BFCP_FLOOR_STATUS_ACK, user->getUserID(), _1, _2);
-    user->runSendMessageTask(boost::bind(&BfcpConnection::notifyFloorStatus,
-      connection_, basicParam, getFloorStatusParam(floorID)));
+    EncodedMsgPtr encodedMsg = connection_->encodeFloorStatus(
+      conferenceID_, getFloorStatusParam(floorID));
+    if (!encodedMsg) return;
+    pushNotification(user, NotificationQueue::kFloorStatus, floorID,
+      BFCP_FLOOR_STATUS_ACK, encodedMsg);
   }
 }
 
@@ -1748,17 +1795,16 @@ void Conference::getFloorRequestInfoParamsByFloorID(
   uint16_t floorID, 
   const FloorRequestQueue &queue) const
 {
-  for (auto it = queue.rbegin(); it != queue.rend(); ++it)
+  auto floorRequests = queue.findByFloorID(floorID);
+  for (auto it = floorRequests.rbegin(); it != floorRequests.rend(); ++it)
   {
-    if ((*it)->findFloor(floorID))
-    {
-      frqInfoList.push_back((*it)->toFloorRequestInfoParam(users_));
-    }
+    frqInfoList.push_back((*it)->toFloorRequestInfoParam(users_));
   }
 }
 
 void Conference::onResponse(bfcp_prim expectedPrimitive,
                             uint16_t userID,
+                            uint32_t notificationID,
                             ResponseError err, 
                             const BfcpMsgPtr &msg)
 {
@@ -1774,6 +1820,16 @@ void Conference::onResponse(bfcp_prim expectedPrimitive,
   {
     LOG_TRACE << "Conference received response with error " 
               << response_error_name(err);
+    // NOTE: with a window above 1, the other notifications in flight 
+    // may fail later, they are cleared below, so their failures must not
+    // make the user unavailable again after it's back
+    if (!user->onSendMessageTaskFailed(notificationID))
+    {
+      LOG_DEBUG << "Ignore the failure of notification " << notificationID
+                << " to User " << userID << " in Conference " << conferenceID_
+                << ", it's no longer in flight";
+      return;
+    }
     LOG_INFO << "Set User " << userID << " in Conference " << conferenceID_ 
              <<" to unavailable";
     user->setAvailable(false);
@@ -1792,7 +1848,7 @@ void Conference::onResponse(bfcp_prim expectedPrimitive,
     user->setActiveTime(msg->getReceivedTime());
     if (isUserAvailable(user))
     {
-      user->runNextSendMessageTask();
+      user->onSendMessageTaskAcked(notificationID);
     }
   }
 }
@@ -1810,6 +1866,13 @@ string Conference::getConferenceInfo() const
   conferenceElement->SetAttribute("acceptPolicy", toString(acceptPolicy_));
   conferenceElement->SetAttribute("userObsoletedTime", userObsoletedTime_);
 
+  FloorRequestPool::Stats poolStats = floorRequestPool_->getStats();
+  tinyxml2::XMLElement *poolElement = doc.NewElement("floorRequestPool");
+  poolElement->SetAttribute("hits", static_cast<unsigned>(poolStats.hits));
+  poolElement->SetAttribute("misses", static_cast<unsigned>(poolStats.misses));
+  poolElement->SetAttribute("nodesHeld", static_cast<unsigned>(poolStats.nodesHeld));
+  conferenceElement->InsertEndChild(poolElement);
+
   addUserInfoToXMLNode(&doc, conferenceElement);
   addFloorInfoToXMLNode(&doc, conferenceElement);
   addQueueInfoToXMLNode(&doc, conferenceElement, pending_, "pendingQueue");
@@ -1838,6 +1901,20 @@ void Conference::addUserInfoToXMLNode(tinyxml2::XMLDocument *doc,
       userNode->SetAttribute("uri", user.second->getURI().c_str());
     }
     userNode->SetAttribute("isAvailable", isUserAvailable(user.second));
+    const NotificationQueue::Stats &stats = 
+      user.second->getNotificationQueueStats();
+    tinyxml2::XMLElement *queueNode = doc->NewElement("notificationQueue");
+    queueNode->SetAttribute(
+      "depth", static_cast<unsigned>(user.second->getNotificationQueueDepth()));
+    queueNode->SetAttribute("maxDepth", static_cast<unsigned>(stats.maxDepth));
+    queueNode->SetAttribute(
+      "inFlight", static_cast<unsigned>(user.second->getNotificationsInFlight()));
+    queueNode->SetAttribute(
+      "maxInFlight", static_cast<unsigned>(stats.maxInFlight));
+    queueNode->SetAttribute("sent", static_cast<unsigned>(stats.sent));
+    queueNode->SetAttribute("replaced", static_cast<unsigned>(stats.replaced));
+    queueNode->SetAttribute("overflows", static_cast<unsigned>(stats.overflows));
+    userNode->InsertEndChild(queueNode);
     userListNode->InsertEndChild(userNode);
   }
 }
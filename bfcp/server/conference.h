@@ -1,18 +1,24 @@
 #ifndef BFCP_CONFERENCE_H
 #define BFCP_CONFERENCE_H
 
-#include <map>
 #include <list>
 #include <unordered_map>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/function.hpp>
 
 #include <muduo/net/EventLoop.h>
 
 #include <bfcp/common/bfcp_param.h>
 #include <bfcp/common/bfcp_callbacks.h>
+#include <bfcp/common/bfcp_flat_map.h>
+#include <bfcp/common/bfcp_id_set.h>
 #include <bfcp/server/conference_define.h>
+#include <bfcp/server/floor_request_pool.h>
+#include <bfcp/server/floor_request_queue.h>
+#include <bfcp/server/notification_queue.h>
 
 namespace tinyxml2
 {
@@ -24,17 +30,21 @@ namespace bfcp
 {
 class BfcpMsg;
 class BfcpConnection;
+class EncodedMsg;
 class User;
 class Floor;
 class FloorRequestNode;
 typedef boost::shared_ptr<BfcpConnection> BfcpConnectionPtr;
+typedef boost::shared_ptr<const EncodedMsg> EncodedMsgPtr;
 typedef boost::shared_ptr<User> UserPtr;
 typedef boost::shared_ptr<Floor> FloorPtr;
 typedef boost::shared_ptr<FloorRequestNode> FloorRequestNodePtr;
 
-typedef std::map<uint16_t, UserPtr> UserDict;
+typedef FlatMap<uint16_t, UserPtr> UserDict;
+typedef FlatMap<uint16_t, FloorPtr> FloorDict;
 
-class Conference
+// NOTE: must be created by boost::make_shared
+class Conference : public boost::enable_shared_from_this<Conference>
 {
 public:
   typedef boost::function<
@@ -42,7 +52,8 @@ public:
   > FloorRequestExpiredCallback;
   
   typedef boost::function<
-    void (uint32_t, bfcp_prim, uint16_t, ResponseError, const BfcpMsgPtr&)
+    void (uint32_t, bfcp_prim, uint16_t, uint32_t, 
+          ResponseError, const BfcpMsgPtr&)
   > ClientResponseCallback;
 
 public:
@@ -72,6 +83,8 @@ public:
   ControlError removeChair(uint16_t floorID);
 
   string getConferenceInfo() const;
+  FloorRequestPool::Stats getFloorRequestPoolStats() const
+  { return floorRequestPool_->getStats(); }
   
   // onTimeoutForChairAction should be called in cb.
   void setChairActionTimeoutCallback(const FloorRequestExpiredCallback &cb)
@@ -91,18 +104,26 @@ public:
   void setClientReponseCallback(ClientResponseCallback &&cb)
   { clientReponseCallback_ = std::move(cb); }
 
+  // NOTE: call before the conference runs
+  // the notifications marked in a loop iteration are flushed at its end
+  // if the conference runs in its loop, otherwise flushNotifications 
+  // must be called at the end of each task running the conference
+  void enableFlushNotificationsInLoop() { isFlushingNotificationsInLoop_ = true; }
+
+  // send the notifications of the floors and floor requests changed
+  void flushNotifications();
+
   void onNewRequest(const BfcpMsgPtr &msg);
   void onResponse(
     bfcp_prim expectedPrimitive,
     uint16_t userID,
+    uint32_t notificationID,
     ResponseError err, 
     const BfcpMsgPtr &msg);
   void onTimeoutForChairAction(uint16_t floorRequestID);
   void onTimeoutForHoldingFloors(uint16_t floorRequestID);
 
 private:
-  typedef std::list<FloorRequestNodePtr> FloorRequestQueue;
-
   void initRequestHandlers();
   void handleFloorRequest(const BfcpMsgPtr &msg);
   void handleFloorRelease(const BfcpMsgPtr &msg);
@@ -136,10 +157,29 @@ private:
   FloorRequestNodePtr checkFloorRequestInGrantedQueue(
     const BfcpMsgPtr &msg, uint16_t floorRequestID);
 
+  // the floors and floor requests notified are marked as changed,
+  // and the query users get one notification for each of them
+  // when flushed
   void notifyFloorAndRequestInfo(const FloorRequestNodePtr &floorRequest);
   void notifyWithFloorRequestStatus(const FloorRequestNodePtr &floorRequest);
   void notifyWithFloorStatus(uint16_t floorID);
   void notifyWithFloorStatus(uint16_t userID, uint16_t floorID);
+  void queueNotificationFlush();
+  static void flushNotificationsOf(const boost::weak_ptr<Conference> &conference);
+  void sendFloorStatus(uint16_t floorID);
+  void sendFloorRequestStatus(const FloorRequestNodePtr &floorRequest);
+  void sendNotification(uint16_t userID, 
+                        bfcp_prim expectedPrimitive,
+                        const EncodedMsgPtr &encodedMsg, 
+                        uint32_t notificationID);
+  // queue the notification to the user, 
+  // resync the notifications of the user first if the queue is full
+  void pushNotification(const UserPtr &user,
+                        NotificationQueue::Type type,
+                        uint16_t id,
+                        bfcp_prim expectedPrimitive,
+                        const EncodedMsgPtr &encodedMsg);
+  void resyncNotifications(const UserPtr &user);
 
   void replyWithError(const BfcpMsgPtr &msg, bfcp_err err, const char *errInfo);
   void replyWithFloorStatus(const BfcpMsgPtr &msg, const uint16_t *floorID);
@@ -153,13 +193,13 @@ private:
   void insertFloorRequestToQueue(
     FloorRequestQueue &queue, FloorRequestNodePtr &floorRequest);
 
-  FloorRequestNodePtr findFloorRequest(FloorRequestQueue &queue, uint16_t floorRequestID);
   FloorRequestNodePtr removeFloorRequest(uint16_t floorRequestID, uint16_t userID);
   FloorRequestNodePtr extractFloorRequestFromQueue(
     FloorRequestQueue &queue, uint16_t floorRequestID, uint16_t userID);
   bool revokeFloorsFromFloorRequest(FloorRequestNodePtr &floorRequest);
 
-  void updateQueuePosition(FloorRequestQueue &queue);
+  void addQueryUserToFloor(const FloorPtr &floor, uint16_t userID);
+  void clearFloorQueryOfUser(uint16_t userID);
 
   void cancelFloorRequestsFromPendingByFloorID(uint16_t floorID);
   void cancelFloorRequestsFromAcceptedByFloorID(uint16_t floorID);
@@ -237,19 +277,28 @@ private:
   double timeForChairAction_;
   AcceptPolicy acceptPolicy_;
 
+  FloorRequestPoolPtr floorRequestPool_;
   FloorRequestQueue pending_;
   FloorRequestQueue accepted_;
   FloorRequestQueue granted_;
 
   UserDict users_;
-  std::map<uint16_t, FloorPtr> floors_;
+  FloorDict floors_;
   HandlerDict requestHandler_;
 
+  // changed since the last notification flush
+  IdSet changedFloors_;
+  IdSet changedFloorRequestIDs_;
+  std::vector<FloorRequestNodePtr> changedFloorRequests_;
+  bool isFlushingNotificationsInLoop_;
+  bool notificationFlushQueued_;
+
   FloorRequestExpiredCallback chairActionTimeoutCallback_;
   FloorRequestExpiredCallback holdingTimeoutCallback_;
   ClientResponseCallback clientReponseCallback_;
 
   double userObsoletedTime_;
+  size_t notificationWindow_;
 };
 
 } // namespace bfcp
@@ -29,6 +29,7 @@ struct ConferenceConfig
   AcceptPolicy acceptPolicy;
   double timeForChairAction; // when < 0.0, unlimited
   double userObsoletedTime; // when < 0.0, unlimited
+  size_t notificationWindow; // max unacknowledged notifications of a user
 };
 
 struct FloorConfig
@@ -1,10 +1,10 @@
 #ifndef BFCP_FLOOR_H
 #define BFCP_FLOOR_H
 
-#include <set>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <bfcp/common/bfcp_ex.h>
+#include <bfcp/common/bfcp_id_set.h>
 
 
 namespace bfcp
@@ -13,7 +13,7 @@ namespace bfcp
 class Floor : boost::noncopyable
 {
 public:
-  typedef std::set<uint16_t> QueryUserSet;
+  typedef IdSet QueryUserSet;
 
   Floor(uint16_t floorID, uint16_t maxGrantedCount, double maxHoldingTime)
       : floorID_(floorID), 
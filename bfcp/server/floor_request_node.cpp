@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <bfcp/server/user.h>
+#include <bfcp/server/floor_request_queue.h>
 
 namespace bfcp
 {
@@ -16,6 +17,20 @@ public:
   {
     return lhs.getFloorID() < floorID;
   }
+
+  bool operator()(const FloorNode &lhs, const FloorNode &rhs)
+  {
+    return lhs.getFloorID() < rhs.getFloorID();
+  }
+};
+
+class FloorNodeEqual
+{
+public:
+  bool operator()(const FloorNode &lhs, const FloorNode &rhs)
+  {
+    return lhs.getFloorID() == rhs.getFloorID();
+  }
 };
 
 } // namespace detail
@@ -28,7 +43,8 @@ FloorRequestNode::FloorRequestNode(uint16_t floorRequestID,
       hasBeneficiary_(param.hasBeneficiaryID),
       beneficiaryID_(param.beneficiaryID),
       priority_(param.priority),
-      participantInfo_(param.pInfo)
+      participantInfo_(param.pInfo),
+      rankingQueue_(nullptr)
 {
   requestStatus_.status = BFCP_PENDING;
   requestStatus_.qpos = 0;
@@ -36,20 +52,45 @@ FloorRequestNode::FloorRequestNode(uint16_t floorRequestID,
   setFloors(param.floorIDs); 
 }
 
+void FloorRequestNode::reset(uint16_t floorRequestID, 
+                             uint16_t userID, 
+                             const FloorRequestParam &param)
+{
+  floorRequestID_ = floorRequestID;
+  userID_ = userID;
+  hasBeneficiary_ = param.hasBeneficiaryID;
+  beneficiaryID_ = param.beneficiaryID;
+  priority_ = param.priority;
+  requestStatus_.status = BFCP_PENDING;
+  requestStatus_.qpos = 0;
+  participantInfo_.assign(param.pInfo);
+  statusInfo_.clear();
+  queryUsers_.clear();
+  expiredTimer_ = muduo::net::TimerId();
+  rankingQueue_ = nullptr;
+
+  setFloors(param.floorIDs);
+}
+
 void FloorRequestNode::setFloors( const bfcp_floor_id_list &floorIDs )
 {
-  bfcp_floor_id_list uniqueFloorIDs = floorIDs;
-  std::sort(uniqueFloorIDs.begin(), uniqueFloorIDs.end());
-  uniqueFloorIDs.erase(
-    std::unique(uniqueFloorIDs.begin(), uniqueFloorIDs.end()), 
-    uniqueFloorIDs.end());
-  
-  floors_.reserve(uniqueFloorIDs.size());
+  // sort and unique the floors in place, no temporary floor ID list
   floors_.clear();
-  for (auto floorID : uniqueFloorIDs)
+  floors_.reserve(floorIDs.size());
+  for (auto floorID : floorIDs)
   {
     floors_.emplace_back(floorID);
   }
+  std::sort(floors_.begin(), floors_.end(), detail::FloorNodeCmp());
+  floors_.erase(
+    std::unique(floors_.begin(), floors_.end(), detail::FloorNodeEqual()),
+    floors_.end());
+}
+
+uint8_t FloorRequestNode::getQueuePosition() const
+{
+  return rankingQueue_ ? 
+    rankingQueue_->getQueuePosition(floorRequestID_) : requestStatus_.qpos;
 }
 
 FloorNode* FloorRequestNode::findFloor( uint16_t floorID )
@@ -146,6 +187,7 @@ FloorRequestNode::toFloorRequestInfoParam(const UserDict &users) const
     param.oRS.floorRequestID = floorRequestID_;
     param.oRS.hasRequestStatus = true;
     param.oRS.requestStatus = requestStatus_;
+    param.oRS.requestStatus.qpos = getQueuePosition();
     param.oRS.statusInfo = statusInfo_;
   }
   return param;
@@ -3,20 +3,22 @@
 
 #include <vector>
 #include <list>
-#include <set>
 #include <map>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <muduo/net/TimerId.h>
 #include <bfcp/common/bfcp_param.h>
+#include <bfcp/common/bfcp_flat_map.h>
+#include <bfcp/common/bfcp_id_set.h>
 
 namespace bfcp
 {
 
 class User;
+class FloorRequestQueue;
 typedef boost::shared_ptr<User> UserPtr;
-typedef std::map<uint16_t, UserPtr> UserDict;
+typedef FlatMap<uint16_t, UserPtr> UserDict;
 
 class FloorNode
 {
@@ -54,13 +56,19 @@ typedef std::vector<FloorNode> FloorNodeList;
 class FloorRequestNode : boost::noncopyable
 {
 public:
-  typedef std::set<uint16_t> QueryUserSet;
+  typedef IdSet QueryUserSet;
 
 public:
   FloorRequestNode(uint16_t floorRequestID,
                    uint16_t userID,
                    const FloorRequestParam &param);
 
+  // reinitialize a recycled floor request,
+  // the capacity of the floor list and the strings is kept
+  void reset(uint16_t floorRequestID,
+             uint16_t userID,
+             const FloorRequestParam &param);
+
   FloorNode* findFloor(uint16_t floorID);
   const FloorNode* findFloor(uint16_t floorID) const;
   bool isAllFloorStatus(bfcp_reqstat status) const;
@@ -77,7 +85,11 @@ public:
   bfcp_reqstat getOverallStatus() const { return requestStatus_.status; }
 
   void setQueuePosition(uint8_t qpos) { requestStatus_.qpos = qpos; }
-  uint8_t getQueuePosition() const { return requestStatus_.qpos; }
+  // return the position in the ranking queue if it's in one,
+  // otherwise the one set by setQueuePosition
+  uint8_t getQueuePosition() const;
+  // set by the queue which computes the queue position on demand
+  void setRankingQueue(const FloorRequestQueue *queue) { rankingQueue_ = queue; }
 
   void setPrioriy(bfcp_priority priority) { priority_ = priority; }
   bfcp_priority getPriority() const { return priority_; }
@@ -115,6 +127,7 @@ private:
   QueryUserSet queryUsers_;
   FloorNodeList floors_;
   muduo::net::TimerId expiredTimer_; // for chair action or holding timeout
+  const FloorRequestQueue *rankingQueue_;
 };
 
 typedef boost::shared_ptr<FloorRequestNode> FloorRequestNodePtr;
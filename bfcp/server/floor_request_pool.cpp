@@ -0,0 +1,178 @@
+#include <bfcp/server/floor_request_pool.h>
+
+#include <cassert>
+#include <new>
+
+namespace bfcp
+{
+
+// allocates the shared_ptr control blocks from the pool
+template <typename T>
+class FloorRequestPool::BlockAllocator
+{
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind { typedef BlockAllocator<U> other; };
+
+  explicit BlockAllocator(const FloorRequestPoolPtr &pool)
+      : pool_(pool)
+  {}
+
+  template <typename U>
+  BlockAllocator(const BlockAllocator<U> &other)
+      : pool_(other.pool_)
+  {}
+
+  T* allocate(size_t n, const void* = nullptr)
+  {
+    return static_cast<T*>(pool_->allocateBlock(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n)
+  {
+    pool_->deallocateBlock(p, n * sizeof(T));
+  }
+
+  void construct(T *p, const T &value) { ::new(static_cast<void*>(p)) T(value); }
+  void destroy(T *p) { p->~T(); }
+  size_t max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+
+  template <typename U>
+  bool operator==(const BlockAllocator<U> &other) const
+  { return pool_ == other.pool_; }
+
+  template <typename U>
+  bool operator!=(const BlockAllocator<U> &other) const
+  { return pool_ != other.pool_; }
+
+private:
+  template <typename U> friend class BlockAllocator;
+
+  FloorRequestPoolPtr pool_;
+};
+
+class FloorRequestPool::NodeDeleter
+{
+public:
+  explicit NodeDeleter(const FloorRequestPoolPtr &pool)
+      : pool_(pool)
+  {}
+
+  void operator()(FloorRequestNode *node) { pool_->release(node); }
+
+private:
+  FloorRequestPoolPtr pool_;
+};
+
+FloorRequestPool::FloorRequestPool(size_t maxFreeNodes)
+    : maxFreeNodes_(maxFreeNodes),
+      blockSize_(0)
+{
+}
+
+FloorRequestPool::~FloorRequestPool()
+{
+  for (auto node : freeNodes_)
+  {
+    delete node;
+  }
+  for (auto block : freeBlocks_)
+  {
+    ::operator delete(block);
+  }
+}
+
+FloorRequestNodePtr FloorRequestPool::create(uint16_t floorRequestID,
+                                             uint16_t userID,
+                                             const FloorRequestParam &param)
+{
+  FloorRequestNode *node = nullptr;
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (!freeNodes_.empty())
+    {
+      node = freeNodes_.back();
+      freeNodes_.pop_back();
+      --stats_.nodesHeld;
+      ++stats_.hits;
+    }
+    else
+    {
+      ++stats_.misses;
+    }
+  }
+
+  if (node)
+  {
+    node->reset(floorRequestID, userID, param);
+  }
+  else
+  {
+    node = new FloorRequestNode(floorRequestID, userID, param);
+  }
+
+  FloorRequestPoolPtr self = shared_from_this();
+  return FloorRequestNodePtr(
+    node, NodeDeleter(self), BlockAllocator<FloorRequestNode>(self));
+}
+
+FloorRequestPool::Stats FloorRequestPool::getStats() const
+{
+  muduo::MutexLockGuard lock(mutex_);
+  return stats_;
+}
+
+void FloorRequestPool::release(FloorRequestNode *node)
+{
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (freeNodes_.size() < maxFreeNodes_)
+    {
+      freeNodes_.push_back(node);
+      ++stats_.nodesHeld;
+      return;
+    }
+  }
+  delete node;
+}
+
+void* FloorRequestPool::allocateBlock(size_t size)
+{
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (blockSize_ == 0)
+    {
+      blockSize_ = size;
+    }
+    if (size == blockSize_ && !freeBlocks_.empty())
+    {
+      void *block = freeBlocks_.back();
+      freeBlocks_.pop_back();
+      return block;
+    }
+  }
+  return ::operator new(size);
+}
+
+void FloorRequestPool::deallocateBlock(void *block, size_t size)
+{
+  {
+    muduo::MutexLockGuard lock(mutex_);
+    if (size == blockSize_ && freeBlocks_.size() < maxFreeNodes_)
+    {
+      freeBlocks_.push_back(block);
+      return;
+    }
+  }
+  ::operator delete(block);
+}
+
+} // namespace bfcp
@@ -0,0 +1,71 @@
+#ifndef BFCP_FLOOR_REQUEST_POOL_H
+#define BFCP_FLOOR_REQUEST_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <muduo/base/Mutex.h>
+
+#include <bfcp/server/floor_request_node.h>
+
+namespace bfcp
+{
+
+class FloorRequestPool;
+typedef boost::shared_ptr<FloorRequestPool> FloorRequestPoolPtr;
+
+// Pool of the floor request nodes of a conference.
+// The released nodes are kept with the capacity of their floor lists and
+// strings, the shared_ptr control blocks are recycled too,
+// so creating and releasing floor requests doesn't touch the heap
+// in steady state.
+// NOTE: must be created by boost::make_shared,
+// the nodes created by the pool keep the pool alive.
+class FloorRequestPool : public boost::enable_shared_from_this<FloorRequestPool>,
+                         boost::noncopyable
+{
+public:
+  static const size_t kDefaultMaxFreeNodes = 1024;
+
+  typedef struct Stats
+  {
+    Stats() : hits(0), misses(0), nodesHeld(0) {}
+
+    uint64_t hits;
+    uint64_t misses;
+    size_t nodesHeld; // free nodes held by the pool
+  } Stats;
+
+  explicit FloorRequestPool(size_t maxFreeNodes = kDefaultMaxFreeNodes);
+  ~FloorRequestPool();
+
+  FloorRequestNodePtr create(uint16_t floorRequestID,
+                             uint16_t userID,
+                             const FloorRequestParam &param);
+
+  Stats getStats() const;
+
+private:
+  template <typename T> class BlockAllocator;
+  class NodeDeleter;
+
+  void release(FloorRequestNode *node);
+  void* allocateBlock(size_t size);
+  void deallocateBlock(void *block, size_t size);
+
+  const size_t maxFreeNodes_;
+  mutable muduo::MutexLock mutex_;
+  std::vector<FloorRequestNode*> freeNodes_;
+  // the control blocks have the same size, which is known on first use
+  std::vector<void*> freeBlocks_;
+  size_t blockSize_;
+  Stats stats_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_FLOOR_REQUEST_POOL_H
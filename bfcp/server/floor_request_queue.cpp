@@ -0,0 +1,261 @@
+#include <bfcp/server/floor_request_queue.h>
+
+#include <cassert>
+#include <iterator>
+#include <limits>
+
+namespace bfcp
+{
+
+FloorRequestQueue::FloorRequestQueue(bool hasQueuePosition)
+    : hasQueuePosition_(hasQueuePosition)
+{
+  std::fill(priorityFront_, priorityFront_ + kPriorityNum, queue_.end());
+}
+
+FloorRequestNodePtr FloorRequestQueue::find(uint16_t floorRequestID) const
+{
+  auto it = index_.find(floorRequestID);
+  return it != index_.end() ? *(*it).second.pos : nullptr;
+}
+
+FloorRequestQueue::FloorRequestList FloorRequestQueue::findByFloorID(
+  uint16_t floorID) const
+{
+  return findInIndex(floorIndex_, floorID);
+}
+
+FloorRequestQueue::FloorRequestList FloorRequestQueue::findByUserID(
+  uint16_t userID) const
+{
+  return findInIndex(userIndex_, userID);
+}
+
+uint8_t FloorRequestQueue::getQueuePosition(uint16_t floorRequestID) const
+{
+  auto it = index_.find(floorRequestID);
+  if (it == index_.end()) return 0;
+  // the back of the queue has the greatest order key
+  size_t qpos = ranks_.size() - ranks_.rank((*it).second.order);
+  // the queue position in msg has 8 bits
+  return static_cast<uint8_t>((std::min)(qpos, static_cast<size_t>((std::numeric_limits<uint8_t>::max)())));
+}
+
+FloorRequestQueue::FloorRequestList FloorRequestQueue::findInIndex(
+  const OrderedIndexDict &indexes, uint16_t id)
+{
+  FloorRequestList floorRequests;
+  auto it = indexes.find(id);
+  if (it != indexes.end())
+  {
+    floorRequests.reserve((*it).second.size());
+    for (auto &item : (*it).second)
+    {
+      floorRequests.push_back(item.second);
+    }
+  }
+  return floorRequests;
+}
+
+void FloorRequestQueue::insert(const FloorRequestNodePtr &floorRequest)
+{
+  // the position is the first floor request with the same or higher priority
+  int priority = getPriorityIndex(floorRequest);
+  iterator pos = queue_.begin();
+  if (priority != BFCP_PRIO_LOWEST)
+  {
+    pos = queue_.end();
+    for (int i = priority; i < kPriorityNum; ++i)
+    {
+      if (priorityFront_[i] != queue_.end())
+      {
+        pos = priorityFront_[i];
+        break;
+      }
+    }
+  }
+  iterator it = insert(pos, floorRequest);
+  if (priority != BFCP_PRIO_LOWEST)
+  {
+    priorityFront_[priority] = it;
+  }
+}
+
+void FloorRequestQueue::insert(const FloorRequestNodePtr &floorRequest,
+                               uint8_t qpos)
+{
+  assert(qpos != 0);
+  floorRequest->setPrioriy(BFCP_PRIO_LOWEST);
+  // insert before the floor request at qpos - 1
+  iterator pos = queue_.begin();
+  if (qpos == 1)
+  {
+    pos = queue_.end();
+  }
+  else if (qpos - 1u < queue_.size())
+  {
+    const uint16_t *floorRequestID = ranks_.select(queue_.size() - (qpos - 1));
+    assert(floorRequestID);
+    pos = index_[*floorRequestID].pos;
+  }
+  insert(pos, floorRequest);
+}
+
+FloorRequestQueue::iterator FloorRequestQueue::insert(
+  iterator pos, const FloorRequestNodePtr &floorRequest)
+{
+  iterator it = queue_.insert(pos, floorRequest);
+  IndexEntry entry = { it, 0 };
+  bool inserted = index_.insert(
+    std::make_pair(floorRequest->getFloorRequestID(), entry)).second;
+  assert(inserted); (void)inserted;
+  if (hasQueuePosition_)
+  {
+    floorRequest->setRankingQueue(this);
+  }
+
+  if (assignOrder(it))
+  {
+    addToIndexes(floorRequest, getOrder(it));
+  }
+  else // no order key left between the neighbours
+  {
+    reassignOrders();
+  }
+  return it;
+}
+
+uint64_t FloorRequestQueue::getOrder(const_iterator it) const
+{
+  auto entry = index_.find((*it)->getFloorRequestID());
+  assert(entry != index_.end());
+  return (*entry).second.order;
+}
+
+bool FloorRequestQueue::assignOrder(iterator it)
+{
+  bool hasPrev = it != queue_.begin();
+  bool hasNext = std::next(it) != queue_.end();
+  uint64_t prev = hasPrev ? getOrder(std::prev(it)) : 0;
+  uint64_t next = hasNext ? getOrder(std::next(it)) : 0;
+
+  uint64_t order = kInitialOrder;
+  if (hasPrev && hasNext)
+  {
+    if (next - prev < 2) return false;
+    order = prev + (next - prev) / 2;
+  }
+  else if (hasPrev)
+  {
+    if (prev > (std::numeric_limits<uint64_t>::max)() - kOrderGap) return false;
+    order = prev + kOrderGap;
+  }
+  else if (hasNext)
+  {
+    if (next <= kOrderGap) return false;
+    order = next - kOrderGap;
+  }
+  index_[(*it)->getFloorRequestID()].order = order;
+  return true;
+}
+
+void FloorRequestQueue::reassignOrders()
+{
+  floorIndex_.clear();
+  userIndex_.clear();
+  ranks_.clear();
+  uint64_t order = kOrderGap;
+  for (auto &floorRequest : queue_)
+  {
+    index_[floorRequest->getFloorRequestID()].order = order;
+    addToIndexes(floorRequest, order);
+    order += kOrderGap;
+  }
+}
+
+void FloorRequestQueue::addToIndexes(
+  const FloorRequestNodePtr &floorRequest, uint64_t order)
+{
+  ranks_.insert(order, floorRequest->getFloorRequestID());
+  auto item = std::make_pair(order, floorRequest);
+  for (auto &floorNode : floorRequest->getFloorNodeList())
+  {
+    floorIndex_[floorNode.getFloorID()].insert(item);
+  }
+  userIndex_[floorRequest->getUserID()].insert(item);
+  if (floorRequest->hasBeneficiary() && 
+      floorRequest->getBeneficiaryID() != floorRequest->getUserID())
+  {
+    userIndex_[floorRequest->getBeneficiaryID()].insert(item);
+  }
+}
+
+void FloorRequestQueue::removeFromIndexes(
+  const FloorRequestNodePtr &floorRequest, uint64_t order)
+{
+  ranks_.erase(order);
+  for (auto &floorNode : floorRequest->getFloorNodeList())
+  {
+    removeFromIndex(floorIndex_, floorNode.getFloorID(), order);
+  }
+  removeFromIndex(userIndex_, floorRequest->getUserID(), order);
+  if (floorRequest->hasBeneficiary() && 
+      floorRequest->getBeneficiaryID() != floorRequest->getUserID())
+  {
+    removeFromIndex(userIndex_, floorRequest->getBeneficiaryID(), order);
+  }
+}
+
+void FloorRequestQueue::removeFromIndex(
+  OrderedIndexDict &indexes, uint16_t id, uint64_t order)
+{
+  auto it = indexes.find(id);
+  assert(it != indexes.end());
+  (*it).second.erase(order);
+  if ((*it).second.empty())
+  {
+    indexes.erase(it);
+  }
+}
+
+FloorRequestQueue::iterator FloorRequestQueue::erase(iterator it)
+{
+  assert(it != queue_.end());
+  int priority = getPriorityIndex(*it);
+  iterator next = std::next(it);
+  if (priority != BFCP_PRIO_LOWEST && priorityFront_[priority] == it)
+  {
+    // skip the floor requests placed by the chair, which have the lowest
+    // priority, the others are still ordered by priority
+    iterator front = next;
+    while (front != queue_.end() && 
+           getPriorityIndex(*front) == BFCP_PRIO_LOWEST)
+    {
+      ++front;
+    }
+    priorityFront_[priority] = 
+      (front != queue_.end() && getPriorityIndex(*front) == priority) ?
+      front : queue_.end();
+  }
+  auto entry = index_.find((*it)->getFloorRequestID());
+  assert(entry != index_.end());
+  removeFromIndexes(*it, (*entry).second.order);
+  if (hasQueuePosition_)
+  {
+    (*it)->setRankingQueue(nullptr);
+  }
+  index_.erase(entry);
+  queue_.erase(it);
+  return next;
+}
+
+bool FloorRequestQueue::remove(const FloorRequestNodePtr &floorRequest)
+{
+  auto it = index_.find(floorRequest->getFloorRequestID());
+  if (it == index_.end() || *(*it).second.pos != floorRequest)
+    return false;
+  erase((*it).second.pos);
+  return true;
+}
+
+} // namespace bfcp
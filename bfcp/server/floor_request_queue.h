@@ -0,0 +1,120 @@
+#ifndef BFCP_FLOOR_REQUEST_QUEUE_H
+#define BFCP_FLOOR_REQUEST_QUEUE_H
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <bfcp/server/floor_request_node.h>
+#include <bfcp/server/rank_tree.h>
+
+namespace bfcp
+{
+
+// Queue of floor requests ordered from low priority to high priority,
+// the back of the queue is the first one (queue position 1).
+// The floor requests are indexed by floorRequestID,
+// so find and remove are O(1), insert is O(1) by priority.
+// Each floor and each user has its own ordered index of the floor requests
+// with the floor or of the user (as the requester or the beneficiary),
+// so the floor and user scoped operations only touch the relevant ones.
+// The queue positions are computed on demand by ranking the floor requests,
+// so the moving floor requests don't rewrite the positions of the others.
+// NOTE: only the floor requests placed by the chair may break the order,
+// they have the lowest priority.
+class FloorRequestQueue : boost::noncopyable
+{
+public:
+  typedef std::list<FloorRequestNodePtr> List;
+  typedef List::iterator iterator;
+  typedef List::const_iterator const_iterator;
+  typedef List::reverse_iterator reverse_iterator;
+  typedef List::const_reverse_iterator const_reverse_iterator;
+  typedef std::vector<FloorRequestNodePtr> FloorRequestList;
+
+  // the floor requests in the queue report their queue positions
+  // if hasQueuePosition is true
+  explicit FloorRequestQueue(bool hasQueuePosition = false);
+
+  iterator begin() { return queue_.begin(); }
+  iterator end() { return queue_.end(); }
+  const_iterator begin() const { return queue_.begin(); }
+  const_iterator end() const { return queue_.end(); }
+  reverse_iterator rbegin() { return queue_.rbegin(); }
+  reverse_iterator rend() { return queue_.rend(); }
+  const_reverse_iterator rbegin() const { return queue_.rbegin(); }
+  const_reverse_iterator rend() const { return queue_.rend(); }
+
+  size_t size() const { return index_.size(); }
+  bool empty() const { return queue_.empty(); }
+  bool hasQueuePosition() const { return hasQueuePosition_; }
+
+  // return nullptr if not found
+  FloorRequestNodePtr find(uint16_t floorRequestID) const;
+  // return the floor requests with the floor in queue order,
+  // it's a copy so the queue can be modified while walking through it
+  FloorRequestList findByFloorID(uint16_t floorID) const;
+  // same as above, with the user as the requester or the beneficiary
+  FloorRequestList findByUserID(uint16_t userID) const;
+  // return the queue position (starts from 1), 0 if not found
+  uint8_t getQueuePosition(uint16_t floorRequestID) const;
+
+  // insert behind the floor requests with the same or higher priority
+  void insert(const FloorRequestNodePtr &floorRequest);
+  // insert at the queue position (starts from 1) stated by the chair,
+  // the floor request is set to the lowest priority,
+  // insert to the front if the queue position is beyond the queue
+  void insert(const FloorRequestNodePtr &floorRequest, uint8_t qpos);
+
+  iterator erase(iterator it);
+  bool remove(const FloorRequestNodePtr &floorRequest);
+
+private:
+  // the priority in msg has 3 bits
+  static const int kPriorityNum = 8;
+
+  static int getPriorityIndex(const FloorRequestNodePtr &floorRequest)
+  { return (std::min)(static_cast<int>(floorRequest->getPriority()), kPriorityNum - 1); }
+
+  // the order keys keep the relative order of the queue,
+  // the floor and user indexes are ordered by them
+  typedef std::map<uint64_t, FloorRequestNodePtr> OrderedIndex;
+  typedef std::unordered_map<uint16_t, OrderedIndex> OrderedIndexDict;
+
+  struct IndexEntry
+  {
+    iterator pos;
+    uint64_t order;
+  };
+
+  static const uint64_t kOrderGap = static_cast<uint64_t>(1) << 32;
+  static const uint64_t kInitialOrder = static_cast<uint64_t>(1) << 63;
+
+  iterator insert(iterator pos, const FloorRequestNodePtr &floorRequest);
+  uint64_t getOrder(const_iterator it) const;
+  bool assignOrder(iterator it);
+  void reassignOrders();
+  void addToIndexes(const FloorRequestNodePtr &floorRequest, uint64_t order);
+  void removeFromIndexes(const FloorRequestNodePtr &floorRequest, uint64_t order);
+  static FloorRequestList findInIndex(const OrderedIndexDict &indexes, uint16_t id);
+  static void removeFromIndex(OrderedIndexDict &indexes, uint16_t id, uint64_t order);
+
+  const bool hasQueuePosition_;
+  List queue_;
+  std::unordered_map<uint16_t, IndexEntry> index_;
+  // order key -> floorRequestID
+  RankTree<uint64_t, uint16_t> ranks_;
+  OrderedIndexDict floorIndex_;
+  OrderedIndexDict userIndex_;
+  // the first floor request of each priority above the lowest,
+  // end() if there is none
+  iterator priorityFront_[kPriorityNum];
+};
+
+} // namespace bfcp
+
+#endif // BFCP_FLOOR_REQUEST_QUEUE_H
@@ -0,0 +1,146 @@
+#ifndef BFCP_MPSC_QUEUE_H
+#define BFCP_MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+
+namespace bfcp
+{
+
+// Unbounded lock-free multi-producer single-consumer FIFO queue
+// (Vyukov's non-intrusive MPSC queue).
+// push is wait-free, one exchange on the head,
+// pop is done by the consumer without any atomic RMW.
+// NOTE: pop may fail while a producer is between its exchange and
+// linking the node, the element is seen by the next pop.
+// NOTE: pop must be called by one consumer at a time.
+// The nodes popped are kept in a free list for the next pushes,
+// up to maxFreeNodes, so the queue doesn't allocate in steady state.
+template <typename T>
+class MpscQueue : boost::noncopyable
+{
+public:
+  static const size_t kDefaultMaxFreeNodes = 32;
+
+  explicit MpscQueue(size_t maxFreeNodes = kDefaultMaxFreeNodes)
+      : head_(new Node()), 
+        tail_(head_.load(std::memory_order_relaxed)),
+        maxFreeNodes_(maxFreeNodes),
+        freeNodes_(nullptr),
+        numFreeNodes_(0),
+        isTakingFreeNode_(false)
+  {}
+
+  ~MpscQueue()
+  {
+    T value;
+    while (pop(&value)) {}
+    delete tail_;
+    Node *node = freeNodes_.load(std::memory_order_relaxed);
+    while (node)
+    {
+      Node *next = node->next.load(std::memory_order_relaxed);
+      delete node;
+      node = next;
+    }
+  }
+
+  void push(const T &value)
+  {
+    Node *node = allocNode();
+    node->value = value;
+    pushNode(node);
+  }
+
+  void push(T &&value)
+  {
+    Node *node = allocNode();
+    node->value = std::move(value);
+    pushNode(node);
+  }
+
+  // return false if empty
+  bool pop(T *value)
+  {
+    Node *tail = tail_;
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (!next) return false;
+    // next becomes the stub node
+    *value = std::move(next->value);
+    tail_ = next;
+    freeNode(tail);
+    return true;
+  }
+
+private:
+  struct Node : boost::noncopyable
+  {
+    Node() : next(nullptr) {}
+
+    std::atomic<Node*> next; // also links the free nodes
+    T value; // moved out when popped
+  };
+
+  // NOTE: one producer takes from the free list at a time, 
+  // so a node can't be taken and given back under its CAS (no ABA),
+  // the others allocate instead of waiting
+  Node* allocNode()
+  {
+    if (numFreeNodes_.load(std::memory_order_relaxed) > 0 && 
+        !isTakingFreeNode_.exchange(true, std::memory_order_acquire))
+    {
+      Node *node = freeNodes_.load(std::memory_order_acquire);
+      while (node && 
+             !freeNodes_.compare_exchange_weak(
+                node, node->next.load(std::memory_order_relaxed),
+                std::memory_order_acquire, std::memory_order_acquire))
+      {}
+      isTakingFreeNode_.store(false, std::memory_order_release);
+      if (node)
+      {
+        numFreeNodes_.fetch_sub(1, std::memory_order_relaxed);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+      }
+    }
+    return new Node();
+  }
+
+  // NOTE: only called by the consumer
+  void freeNode(Node *node)
+  {
+    // counted before linked, it's never less than the free nodes
+    if (numFreeNodes_.load(std::memory_order_relaxed) >= maxFreeNodes_)
+    {
+      delete node;
+      return;
+    }
+    numFreeNodes_.fetch_add(1, std::memory_order_relaxed);
+    Node *head = freeNodes_.load(std::memory_order_relaxed);
+    do
+    {
+      node->next.store(head, std::memory_order_relaxed);
+    } while (!freeNodes_.compare_exchange_weak(
+                head, node, 
+                std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  void pushNode(Node *node)
+  {
+    Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  std::atomic<Node*> head_; // pushed by the producers
+  Node *tail_; // the stub node, owned by the consumer
+  size_t maxFreeNodes_;
+  std::atomic<Node*> freeNodes_; // given back by the consumer
+  std::atomic<size_t> numFreeNodes_;
+  std::atomic<bool> isTakingFreeNode_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_MPSC_QUEUE_H
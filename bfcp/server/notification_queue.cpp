@@ -0,0 +1,121 @@
+#include <bfcp/server/notification_queue.h>
+
+#include <muduo/base/Logging.h>
+
+namespace bfcp
+{
+
+NotificationQueue::NotificationQueue(size_t window, size_t maxQueued)
+    : window_(window > 0 ? window : 1),
+      maxQueued_(maxQueued > 0 ? maxQueued : 1),
+      nextNotificationID_(0)
+{
+}
+
+void NotificationQueue::setWindow(size_t window)
+{
+  window_ = window > 0 ? window : 1;
+  sendQueued();
+}
+
+bool NotificationQueue::hasRoomFor(Type type, uint16_t id) const
+{
+  return queued_.size() < maxQueued_ 
+      || queuedIndex_.find(toKey(type, id)) != queuedIndex_.end();
+}
+
+void NotificationQueue::push(Type type, uint16_t id, const SendMessageTask &task)
+{
+  uint32_t key = toKey(type, id);
+  // NOTE: the in-flight ones are already sent, they are not indexed here
+  auto it = queuedIndex_.find(key);
+  if (it != queuedIndex_.end())
+  {
+    (*(*it).second).task = task;
+    ++stats_.replaced;
+    return;
+  }
+
+  queuedIndex_[key] = queued_.insert(queued_.end(), Entry(key, task));
+  if (depth() > stats_.maxDepth)
+  {
+    stats_.maxDepth = depth();
+  }
+  sendQueued();
+}
+
+void NotificationQueue::onAcked(uint32_t notificationID)
+{
+  auto it = inFlight_.find(notificationID);
+  if (it == inFlight_.end())
+  {
+    LOG_DEBUG << "Ignore ACK of unknown notification " << notificationID;
+    return;
+  }
+  inFlightKeys_.erase((*it).second);
+  inFlight_.erase(it);
+  sendQueued();
+}
+
+bool NotificationQueue::onFailed(uint32_t notificationID)
+{
+  auto it = inFlight_.find(notificationID);
+  if (it == inFlight_.end())
+  {
+    LOG_DEBUG << "Ignore failure of unknown notification " << notificationID;
+    return false;
+  }
+  inFlightKeys_.erase((*it).second);
+  inFlight_.erase(it);
+  return true;
+}
+
+void NotificationQueue::clearQueued()
+{
+  LOG_WARN << "NotificationQueue is full, clear " << queued_.size() 
+           << " queued notifications";
+  ++stats_.overflows;
+  queued_.clear();
+  queuedIndex_.clear();
+}
+
+void NotificationQueue::clear()
+{
+  queued_.clear();
+  queuedIndex_.clear();
+  inFlight_.clear();
+  inFlightKeys_.clear();
+}
+
+void NotificationQueue::sendQueued()
+{
+  // NOTE: at most window keys are in flight, 
+  // so only a few queued ones are skipped
+  auto it = queued_.begin();
+  while (it != queued_.end() && inFlight_.size() < window_)
+  {
+    uint32_t key = (*it).key;
+    if (inFlightKeys_.find(key) != inFlightKeys_.end())
+    {
+      ++it;
+      continue;
+    }
+
+    SendMessageTask task;
+    task.swap((*it).task);
+    queuedIndex_.erase(key);
+    it = queued_.erase(it);
+
+    uint32_t notificationID = nextNotificationID_++;
+    inFlight_[notificationID] = key;
+    inFlightKeys_[key] = notificationID;
+    ++stats_.sent;
+    if (inFlight_.size() > stats_.maxInFlight)
+    {
+      stats_.maxInFlight = inFlight_.size();
+    }
+    task(notificationID);
+  }
+}
+
+} // namespace bfcp
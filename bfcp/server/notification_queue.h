@@ -0,0 +1,115 @@
+#ifndef BFCP_NOTIFICATION_QUEUE_H
+#define BFCP_NOTIFICATION_QUEUE_H
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+#include <boost/function.hpp>
+
+#include <stdint.h>
+
+namespace bfcp
+{
+
+// Outbound notifications of a user.
+// Up to window notifications are in flight until their ACKs arrive,
+// a queued notification about the same floor or floor request is
+// replaced in place by the newer one, so the user gets the latest state
+// instead of draining stale snapshots.
+// Only one notification about the same floor or floor request is in flight
+// at a time, so the user never gets them out of order.
+// The queue is bounded by maxQueued, but nothing is dropped by the queue,
+// the owner checks hasRoomFor before pushing and, when it's full, 
+// clears the queued ones and pushes the current state instead.
+class NotificationQueue : boost::noncopyable
+{
+public:
+  // the argument is the notification ID passed back to onAcked
+  typedef boost::function<void (uint32_t)> SendMessageTask;
+
+  static const size_t kDefaultWindow = 4;
+  static const size_t kDefaultMaxQueued = 64;
+
+  enum Type
+  {
+    kFloorStatus = 1,
+    kFloorRequestStatus = 2,
+  };
+
+  typedef struct Stats
+  {
+    Stats() 
+        : sent(0), replaced(0), overflows(0), maxDepth(0), maxInFlight(0)
+    {}
+
+    uint64_t sent;
+    uint64_t replaced;  // superseded by a newer one before being sent
+    uint64_t overflows; // the queued ones are cleared as the queue is full
+    size_t maxDepth;
+    size_t maxInFlight;
+  } Stats;
+
+  explicit NotificationQueue(size_t window = kDefaultWindow,
+                             size_t maxQueued = kDefaultMaxQueued);
+
+  // NOTE: window 1 is stop-and-wait
+  void setWindow(size_t window);
+  size_t getWindow() const { return window_; }
+
+  // false if the queue is full and nothing queued would be replaced
+  bool hasRoomFor(Type type, uint16_t id) const;
+  // the task is run at once if the window isn't full
+  // NOTE: it's always queued, even if there is no room for it
+  void push(Type type, uint16_t id, const SendMessageTask &task);
+  // the notification is acknowledged, send the queued ones
+  void onAcked(uint32_t notificationID);
+  // the notification isn't acknowledged, 
+  // return false if it's not in flight (e.g. cleared before it failed)
+  bool onFailed(uint32_t notificationID);
+  // clear the queued ones when the queue is full, 
+  // the in-flight ones are kept until they are acknowledged
+  void clearQueued();
+  // NOTE: the notification IDs are not reused after clear,
+  // so the ACKs and failures of the cleared ones are ignored
+  void clear();
+
+  // in-flight ones included
+  size_t depth() const { return queued_.size() + inFlight_.size(); }
+  size_t inFlight() const { return inFlight_.size(); }
+  const Stats& getStats() const { return stats_; }
+
+private:
+  typedef struct Entry
+  {
+    Entry(uint32_t k, const SendMessageTask &t) : key(k), task(t) {}
+
+    uint32_t key;
+    SendMessageTask task;
+  } Entry;
+
+  typedef std::list<Entry> EntryList;
+  // key -> the queued entry
+  typedef std::unordered_map<uint32_t, EntryList::iterator> QueuedIndex;
+  // notification ID -> key, and key -> notification ID of the in-flight ones
+  typedef std::unordered_map<uint32_t, uint32_t> InFlightIndex;
+
+  static uint32_t toKey(Type type, uint16_t id)
+  { return (static_cast<uint32_t>(type) << 16) | id; }
+
+  void sendQueued();
+
+  size_t window_;
+  size_t maxQueued_;
+  EntryList queued_; // in queued order
+  QueuedIndex queuedIndex_;
+  InFlightIndex inFlight_;
+  InFlightIndex inFlightKeys_;
+  uint32_t nextNotificationID_;
+  Stats stats_;
+};
+
+} // namespace bfcp
+
+#endif // BFCP_NOTIFICATION_QUEUE_H
@@ -0,0 +1,201 @@
+#ifndef BFCP_RANK_TREE_H
+#define BFCP_RANK_TREE_H
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace bfcp
+{
+
+// Ordered set with rank queries, implemented as a treap whose nodes
+// are annotated with the subtree size.
+// insert, erase, rank and select are O(log n) expected.
+template <typename Key, typename Value>
+class RankTree : boost::noncopyable
+{
+public:
+  RankTree() : root_(nullptr), seed_(2463534242u) {}
+  ~RankTree() { clear(); }
+
+  size_t size() const { return sizeOf(root_); }
+  bool empty() const { return root_ == nullptr; }
+
+  // NOTE: the key must not be in the tree
+  void insert(const Key &key, const Value &value);
+  bool erase(const Key &key);
+  void clear() { destroy(root_); root_ = nullptr; }
+
+  // return the number of keys less than key
+  size_t rank(const Key &key) const;
+  // return the value of the n-th smallest key (starts from 0),
+  // nullptr if n is out of range
+  const Value* select(size_t n) const;
+
+private:
+  struct Node
+  {
+    Node(const Key &k, const Value &v, uint32_t p)
+        : key(k), value(v), priority(p), size(1), left(nullptr), right(nullptr)
+    {}
+
+    Key key;
+    Value value;
+    uint32_t priority;
+    size_t size;
+    Node *left;
+    Node *right;
+  };
+
+  static size_t sizeOf(const Node *node) { return node ? node->size : 0; }
+  static void update(Node *node)
+  { node->size = 1 + sizeOf(node->left) + sizeOf(node->right); }
+
+  // split into the keys less than key and the others
+  static void split(Node *node, const Key &key, Node *&less, Node *&others);
+  static Node* merge(Node *less, Node *greater);
+  static void destroy(Node *node);
+
+  uint32_t nextPriority()
+  {
+    // xorshift32
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    return seed_;
+  }
+
+  Node *root_;
+  uint32_t seed_;
+};
+
+template <typename Key, typename Value>
+void RankTree<Key, Value>::insert(const Key &key, const Value &value)
+{
+  Node *less, *others;
+  split(root_, key, less, others);
+  assert(!others || others->key != key);
+  Node *node = new Node(key, value, nextPriority());
+  root_ = merge(merge(less, node), others);
+}
+
+template <typename Key, typename Value>
+bool RankTree<Key, Value>::erase(const Key &key)
+{
+  Node **link = &root_;
+  while (*link && (*link)->key != key)
+  {
+    link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+  }
+  Node *node = *link;
+  if (!node) return false;
+
+  *link = merge(node->left, node->right);
+  delete node;
+  // fix the sizes on the path to the erased node
+  for (Node *it = root_; it && it != *link;)
+  {
+    --it->size;
+    it = key < it->key ? it->left : it->right;
+  }
+  return true;
+}
+
+template <typename Key, typename Value>
+size_t RankTree<Key, Value>::rank(const Key &key) const
+{
+  size_t n = 0;
+  for (const Node *node = root_; node;)
+  {
+    if (node->key < key)
+    {
+      n += sizeOf(node->left) + 1;
+      node = node->right;
+    }
+    else
+    {
+      node = node->left;
+    }
+  }
+  return n;
+}
+
+template <typename Key, typename Value>
+const Value* RankTree<Key, Value>::select(size_t n) const
+{
+  for (const Node *node = root_; node;)
+  {
+    size_t leftSize = sizeOf(node->left);
+    if (n < leftSize)
+    {
+      node = node->left;
+    }
+    else if (n == leftSize)
+    {
+      return &node->value;
+    }
+    else
+    {
+      n -= leftSize + 1;
+      node = node->right;
+    }
+  }
+  return nullptr;
+}
+
+template <typename Key, typename Value>
+void RankTree<Key, Value>::split(
+  Node *node, const Key &key, Node *&less, Node *&others)
+{
+  if (!node)
+  {
+    less = others = nullptr;
+  }
+  else if (node->key < key)
+  {
+    split(node->right, key, node->right, others);
+    less = node;
+    update(node);
+  }
+  else
+  {
+    split(node->left, key, less, node->left);
+    others = node;
+    update(node);
+  }
+}
+
+template <typename Key, typename Value>
+typename RankTree<Key, Value>::Node* RankTree<Key, Value>::merge(
+  Node *less, Node *greater)
+{
+  if (!less) return greater;
+  if (!greater) return less;
+  if (less->priority > greater->priority)
+  {
+    less->right = merge(less->right, greater);
+    update(less);
+    return less;
+  }
+  greater->left = merge(less, greater->left);
+  update(greater);
+  return greater;
+}
+
+template <typename Key, typename Value>
+void RankTree<Key, Value>::destroy(Node *node)
+{
+  while (node)
+  {
+    destroy(node->left);
+    Node *right = node->right;
+    delete node;
+    node = right;
+  }
+}
+
+} // namespace bfcp
+
+#endif // BFCP_RANK_TREE_H
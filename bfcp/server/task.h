@@ -0,0 +1,164 @@
+#ifndef BFCP_TASK_H
+#define BFCP_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/type_traits/is_same.hpp>
+#include <boost/utility/enable_if.hpp>
+
+namespace bfcp
+{
+
+// Move-only callable of void (), run by the thread pool.
+// The callables up to kInlineSize bytes are stored inline,
+// so a task of a few smart pointers and IDs doesn't allocate,
+// the larger ones are moved to the heap.
+class Task
+{
+public:
+  // two smart pointers with several IDs fit in, 
+  // and a node of the task queue still takes one cache line (64-bit)
+  static const size_t kInlineSize = 48;
+
+  Task() : ops_(nullptr) {}
+
+  // NOTE: not explicit, so a bind result or a functor can be passed as a task
+  template <typename F>
+  Task(F f, typename boost::disable_if<boost::is_same<F, Task>, int>::type = 0)
+      : ops_(nullptr)
+  {
+    init(std::move(f), std::integral_constant<bool, IsInline<F>::value>());
+  }
+
+  Task(Task &&other)
+      : ops_(nullptr)
+  {
+    moveFrom(other);
+  }
+
+  Task& operator=(Task &&other)
+  {
+    if (this != &other)
+    {
+      clear();
+      moveFrom(other);
+    }
+    return *this;
+  }
+
+  ~Task() { clear(); }
+
+  void operator()() { ops_->invoke(&storage_); }
+
+  bool empty() const { return ops_ == nullptr; }
+
+  void clear()
+  {
+    if (ops_)
+    {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  typedef std::aligned_storage<
+    kInlineSize, std::alignment_of<void*>::value>::type Storage;
+
+  struct Ops
+  {
+    void (*invoke)(Storage *storage);
+    // move constructs to, then destroys from
+    void (*move)(Storage *from, Storage *to);
+    void (*destroy)(Storage *storage);
+  };
+
+  template <typename F>
+  struct IsInline
+  {
+    static const bool value =
+      sizeof(F) <= sizeof(Storage) &&
+      std::alignment_of<Storage>::value % std::alignment_of<F>::value == 0;
+  };
+
+  template <typename F>
+  struct InlineCallable
+  {
+    static F* get(Storage *storage) { return static_cast<F*>(static_cast<void*>(storage)); }
+    static void invoke(Storage *storage) { (*get(storage))(); }
+    static void move(Storage *from, Storage *to)
+    {
+      ::new(static_cast<void*>(to)) F(std::move(*get(from)));
+      get(from)->~F();
+    }
+    static void destroy(Storage *storage) { get(storage)->~F(); }
+    static const Ops ops;
+  };
+
+  template <typename F>
+  struct HeapCallable
+  {
+    static F*& get(Storage *storage) { return *static_cast<F**>(static_cast<void*>(storage)); }
+    static void invoke(Storage *storage) { (*get(storage))(); }
+    static void move(Storage *from, Storage *to)
+    {
+      ::new(static_cast<void*>(to)) F*(get(from));
+    }
+    static void destroy(Storage *storage) { delete get(storage); }
+    static const Ops ops;
+  };
+
+  template <typename F>
+  void init(F &&f, std::true_type)
+  {
+    ::new(static_cast<void*>(&storage_)) F(std::move(f));
+    ops_ = &InlineCallable<F>::ops;
+  }
+
+  template <typename F>
+  void init(F &&f, std::false_type)
+  {
+    ::new(static_cast<void*>(&storage_)) F*(new F(std::move(f)));
+    ops_ = &HeapCallable<F>::ops;
+  }
+
+  void moveFrom(Task &other)
+  {
+    if (other.ops_)
+    {
+      other.ops_->move(&other.storage_, &storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  // NOTE: move only
+  Task(const Task&);
+  Task& operator=(const Task&);
+
+  Storage storage_;
+  const Ops *ops_;
+};
+
+template <typename F>
+const Task::Ops Task::InlineCallable<F>::ops =
+{
+  &Task::InlineCallable<F>::invoke,
+  &Task::InlineCallable<F>::move,
+  &Task::InlineCallable<F>::destroy,
+};
+
+template <typename F>
+const Task::Ops Task::HeapCallable<F>::ops =
+{
+  &Task::HeapCallable<F>::invoke,
+  &Task::HeapCallable<F>::move,
+  &Task::HeapCallable<F>::destroy,
+};
+
+} // namespace bfcp
+
+#endif // BFCP_TASK_H
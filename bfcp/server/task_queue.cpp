@@ -8,104 +8,48 @@ namespace bfcp
 TaskQueue::TaskQueue( int id, size_t maxQueueSize )
   : id_(id),
     maxQueueSize_(maxQueueSize),
-    mutex_(),
-    notFull_(maxQueueSize > 0 ? new muduo::Condition(mutex_) : nullptr),
-    isInGlobal_(false),
-    isReleasing_(false),
-    isProcessing_(false)
+    size_(0),
+    isScheduled_(false),
+    isReleasing_(false)
 {
 }
 
-void TaskQueue::put( Task &&action, ThreadPool::Priority priority )
+bool TaskQueue::put( Task &&action, ThreadPool::Priority priority )
 {
-  muduo::MutexLockGuard lock(mutex_);
-  while (isFull())
-  {
-    notFull_->wait();
-  }
-  assert(!isFull());
+  if (isFull(priority)) return false;
   if (priority == ThreadPool::kHighPriority)
   { 
-    highPriorityTasks_.emplace_back(std::move(action));
-  }
-  else
-  {
-    normalPriorityTasks_.emplace_back(std::move(action));
-  }
-}
-
-void TaskQueue::put( const Task &action, ThreadPool::Priority priority )
-{
-  muduo::MutexLockGuard lock(mutex_);
-  while (isFull())
-  {
-    notFull_->wait();
-  }
-  assert(!isFull());
-  if (priority == ThreadPool::kHighPriority)
-  {
-    highPriorityTasks_.emplace_back(action);
+    highPriorityTasks_.push(std::move(action));
   }
   else
   {
-    normalPriorityTasks_.emplace_back(action);
+    normalPriorityTasks_.push(std::move(action));
   }
+  ++size_;
+  return true;
 }
 
-TaskQueue::Tasks TaskQueue::take()
+bool TaskQueue::isFull( ThreadPool::Priority priority ) const
 {
-  Tasks tasks;
-
-  muduo::MutexLockGuard lock(mutex_);
-  if (!highPriorityTasks_.empty())
+  // NOTE: the concurrent producers may exceed maxQueueSize a little
+  if (priority != ThreadPool::kHighPriority && 
+      maxQueueSize_ > 0 && 
+      maxQueueSize_ <= size_)
   {
-    tasks.swap(highPriorityTasks_);
-    if (maxQueueSize_ > 0)
-    { 
-      notFull_->notify();
-    }
+    LOG_WARN << "TaskQueue[" << id_ << "] is full";
+    return true;
   }
-  else if (!normalPriorityTasks_.empty())
-  {
-    tasks.emplace_back(std::move(normalPriorityTasks_.front()));
-    normalPriorityTasks_.pop_front();
-    if (maxQueueSize_ > 0)
-    {
-      notFull_->notify();
-    }
-  }
-
-  return tasks;
-}
-
-size_t TaskQueue::size()
-{
-  muduo::MutexLockGuard lock(mutex_);
-  return highPriorityTasks_.size() + normalPriorityTasks_.size();
-}
-
-bool TaskQueue::empty()
-{
-  muduo::MutexLockGuard lock(mutex_);
-  return highPriorityTasks_.empty() && normalPriorityTasks_.empty();
+  return false;
 }
 
-bool TaskQueue::isFull()
+bool TaskQueue::take( Task *task )
 {
-  mutex_.assertLocked();
-  if (maxQueueSize_ > 0)
+  if (highPriorityTasks_.pop(task) || normalPriorityTasks_.pop(task))
   {
-    size_t queueSize = 
-      highPriorityTasks_.size() + normalPriorityTasks_.size();
-    if (maxQueueSize_ <= queueSize)
-    {
-      return true;
-    }
+    --size_;
+    return true;
   }
   return false;
 }
 
-
 } // namespace bfcp
-
-
@@ -1,60 +1,74 @@
 #ifndef BFCP_TASK_QUEUE_H
 #define BFCP_TASK_QUEUE_H
 
-#include <deque>
+#include <atomic>
 
-#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/scoped_ptr.hpp>
-#include <muduo/base/Mutex.h>
-#include <muduo/base/Condition.h>
 
+#include <bfcp/server/mpsc_queue.h>
 #include <bfcp/server/thread_pool.h>
 
 namespace bfcp
 {
 
+// Mailbox of the tasks of one conference, 
+// put by any thread and taken by the worker running it without locking.
+// The high priority tasks are taken before the normal priority ones.
 class TaskQueue : boost::noncopyable
 {
 public:
   typedef ThreadPool::Task Task;
-  typedef std::vector<Task> Tasks;
 
   explicit TaskQueue(int id, size_t maxQueueSize);
 
   int id() const { return id_; }
 
-  void setInGlobal(bool inGlobal) { isInGlobal_ = inGlobal; }
-  bool isInGlobal() const { return isInGlobal_; }
-
-  void setProcessing(bool isProcessing) { isProcessing_ = isProcessing; }
-  bool isProcessing() const { return isProcessing_; }
+  // return false if it's already scheduled,
+  // the queue is scheduled until the worker running it unschedules it
+  bool trySchedule() { return !isScheduled_.exchange(true); }
+  void unschedule() { isScheduled_.store(false); }
+
+  // the thread pool holds the queue while it's scheduled
+  // NOTE: only called by the one who scheduled the queue
+  void setScheduledHolder(const TaskQueuePtr &self) { scheduledHolder_ = self; }
+  TaskQueuePtr releaseScheduledHolder()
+  {
+    TaskQueuePtr self;
+    self.swap(scheduledHolder_);
+    return self;
+  }
 
   bool isReleasing() const { return isReleasing_; }
   void markRelease() { isReleasing_ = true; }
 
-  void put(Task &&task, ThreadPool::Priority priority);
-  void put(const Task &task, ThreadPool::Priority priority);
+  // return false if the queue is full and the task is dropped,
+  // only the normal priority tasks are limited by maxQueueSize
+  bool put(Task &&task, ThreadPool::Priority priority);
 
-  Tasks take();
+  // take the next task, the high priority ones first
+  // NOTE: only called by the worker running the queue,
+  // return false if the pushes are still linking the nodes,
+  // the producers will schedule the queue again after that
+  bool take(Task *task);
 
-  size_t size();
-  bool empty();
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
   
 private:
-  bool isFull();
+  bool isFull(ThreadPool::Priority priority) const;
 
   int id_;
   size_t maxQueueSize_;
-  muduo::MutexLock mutex_;
-  boost::scoped_ptr<muduo::Condition> notFull_;
-  std::vector<Task> highPriorityTasks_;
-  std::deque<Task> normalPriorityTasks_;
-  bool isInGlobal_;
-  bool isReleasing_;
-  bool isProcessing_;
+  MpscQueue<Task> highPriorityTasks_;
+  MpscQueue<Task> normalPriorityTasks_;
+  // counted after pushed, the task counted is taken by the next take
+  // unless an earlier push is still linking its node
+  std::atomic<size_t> size_;
+  std::atomic<bool> isScheduled_;
+  TaskQueuePtr scheduledHolder_;
+  std::atomic<bool> isReleasing_;
 };
 
 } // namespace bfcp
 
-#endif // BFCP_TASK_QUEUE_H
\ No newline at end of file
+#endif // BFCP_TASK_QUEUE_H
@@ -1,18 +1,76 @@
 #include <bfcp/server/thread_pool.h>
 
+#include <thread>
+#include <vector>
+
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
+#include <muduo/base/Condition.h>
 #include <muduo/base/Exception.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Timestamp.h>
 #include <bfcp/server/task_queue.h>
+#include <bfcp/server/work_stealing_deque.h>
 
 namespace bfcp
 {
 
+namespace detail
+{
+// rounds of stealing before parking
+const int kSearchRounds = 3;
+} // namespace detail
+
+struct ThreadPool::Worker : boost::noncopyable
+{
+  explicit Worker(size_t workerIndex)
+      : index(workerIndex),
+        inboxSize(0),
+        isParked(false),
+        unparked(parkMutex),
+        isNotified(false),
+        steals(0),
+        parks(0),
+        unparks(0),
+        randomState(static_cast<uint32_t>(workerIndex) * 2654435761u + 1)
+  {}
+
+  // xorshift32 for choosing the victim to steal
+  uint32_t nextRandom()
+  {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+  }
+
+  const size_t index;
+  WorkStealingDeque<TaskQueue> readyQueues;
+
+  // the queues scheduled by the threads outside the pool
+  muduo::MutexLock inboxMutex;
+  std::vector<TaskQueue*> inbox;
+  std::vector<TaskQueue*> inboxSwapped; // keep the capacity
+  std::atomic<size_t> inboxSize; // checked without locking
+
+  std::atomic<bool> isParked;
+  muduo::MutexLock parkMutex;
+  muduo::Condition unparked;
+  bool isNotified; // guarded by parkMutex
+
+  std::atomic<uint64_t> steals;
+  std::atomic<uint64_t> parks;
+  std::atomic<uint64_t> unparks;
+  uint32_t randomState;
+};
+
 ThreadPool::ThreadPool( const string &name /*= string("ThreadPool")*/ )
-    : mutex_(),
-      notEmpty_(mutex_),
-      name_(name),
+    : name_(name),
+      drainTasks_(kDefaultDrainTasks),
+      drainTime_(-1.0),
+      nextQueueID_(0),
+      numParked_(0),
+      numSearching_(0),
       running_(false)
 {
 }
@@ -27,14 +85,14 @@ ThreadPool::~ThreadPool()
 
 int ThreadPool::createQueue( uint32_t queueID, size_t maxQueueSize )
 {
-  static int nextID = 0;
+  muduo::MutexLockGuard lock(queueMapMutex_);
   auto lb = queueMap_.lower_bound(queueID);
   if (lb == queueMap_.end() || (*lb).first != queueID) // not found
   { 
     auto it = queueMap_.emplace_hint(lb, 
       std::make_pair(
         queueID, 
-        boost::make_shared<TaskQueue>(nextID++, maxQueueSize)));
+        boost::make_shared<TaskQueue>(nextQueueID_++, maxQueueSize)));
     // FIXME: check (*it).first == handle
     (void)(it);
     return 0;
@@ -44,6 +102,7 @@ int ThreadPool::createQueue( uint32_t queueID, size_t maxQueueSize )
 
 int ThreadPool::releaseQueue( uint32_t queueID )
 {
+  muduo::MutexLockGuard lock(queueMapMutex_);
   auto it = queueMap_.find(queueID);
   if (it != queueMap_.end())
   {
@@ -58,13 +117,18 @@ void ThreadPool::start( int numThreads )
   assert(0 <= numThreads);
   assert(threads_.empty());
   running_ = true;
+  workers_.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    workers_.push_back(new Worker(i));
+  }
   threads_.reserve(numThreads);
   for (int i = 0; i < numThreads; ++i)
   {
     char id[32];
     snprintf(id, sizeof id, "%d", i + 1);
     threads_.push_back(new muduo::Thread(
-      boost::bind(&ThreadPool::runInThread, this), name_ + id));
+      boost::bind(&ThreadPool::runInThread, this, &workers_[i]), name_ + id));
     threads_[i].start();
   }
   if (numThreads == 0 && threadInitCallback_)
@@ -75,19 +139,18 @@ void ThreadPool::start( int numThreads )
 
 void ThreadPool::stop()
 {
-  {
-    muduo::MutexLockGuard lock(mutex_);
-    running_ = false;
-    notEmpty_.notifyAll();
-  }
+  running_ = false;
+  unparkAll();
   for (auto &thread : threads_)
   {
     thread.join();
   }
   threads_.clear();
+  clearScheduledQueues();
+  workers_.clear();
 }
 
-int ThreadPool::run( uint32_t queueID, const Task &task, Priority priority )
+int ThreadPool::run( uint32_t queueID, Task &&task, Priority priority )
 {
   if (threads_.empty())
   {
@@ -95,37 +158,40 @@ int ThreadPool::run( uint32_t queueID, const Task &task, Priority priority )
   }
   else
   {
-    auto it = queueMap_.find(queueID);
-    if (it == queueMap_.end())
+    TaskQueuePtr taskQueue = findQueue(queueID);
+    if (!taskQueue)
+    {
+      return kQueueNotFound;
+    }
+    if (!taskQueue->put(std::move(task), priority))
     {
-      return -1;
+      return kQueueFull;
     }
-    (*it).second->put(task, priority);
-    put((*it).second);
+    schedule(taskQueue);
   }
   return 0;
 }
 
-int ThreadPool::run( uint32_t queueID, Task &&task, Priority priority )
+ThreadPool::Stats ThreadPool::getStats() const
 {
-  if (threads_.empty())
+  Stats stats;
+  for (const auto &worker : workers_)
   {
-    task();
+    stats.steals += worker.steals.load(std::memory_order_relaxed);
+    stats.parks += worker.parks.load(std::memory_order_relaxed);
+    stats.unparks += worker.unparks.load(std::memory_order_relaxed);
   }
-  else
-  {
-    auto it = queueMap_.find(queueID);
-    if (it == queueMap_.end())
-    {
-      return -1;
-    }
-    (*it).second->put(std::move(task), priority);
-    put((*it).second);
-  }
-  return 0;
+  return stats;
 }
 
-void ThreadPool::runInThread()
+TaskQueuePtr ThreadPool::findQueue( uint32_t queueID ) const
+{
+  muduo::MutexLockGuard lock(queueMapMutex_);
+  auto it = queueMap_.find(queueID);
+  return it == queueMap_.end() ? TaskQueuePtr() : (*it).second;
+}
+
+void ThreadPool::runInThread(Worker *worker)
 {
   try
   {
@@ -135,16 +201,10 @@ void ThreadPool::runInThread()
     }
     while (running_)
     {
-      auto taskQueue = take();
+      TaskQueue *taskQueue = take(worker);
       if (taskQueue)
       {
-        auto tasks = taskQueue->take();
-        for (auto &task : tasks)
-        {
-          task();
-        }
-        taskQueue->setProcessing(false);
-        put(taskQueue);
+        runTasks(worker, taskQueue);
       }
     }
   }
@@ -168,41 +228,252 @@ void ThreadPool::runInThread()
   }
 }
 
-TaskQueuePtr ThreadPool::take()
+// return nullptr if parked and there is still nothing to run
+TaskQueue* ThreadPool::take(Worker *worker)
 {
-  muduo::MutexLockGuard lock(mutex_);
-  while (globalQueue_.empty() && running_)
+  TaskQueue *taskQueue = takeFromReadyQueues(worker);
+  if (!taskQueue) taskQueue = takeFromInbox(worker);
+  if (taskQueue) return taskQueue;
+
+  // search for a few rounds before parking, 
+  // a yield costs much less than parking and being unparked
+  ++numSearching_;
+  bool stolen = false;
+  for (int round = 0; round < detail::kSearchRounds; ++round)
   {
-    notEmpty_.wait();
+    if (round > 0)
+    {
+      std::this_thread::yield();
+      taskQueue = takeFromInbox(worker);
+      if (taskQueue) break;
+    }
+    taskQueue = steal(worker);
+    if (taskQueue)
+    {
+      stolen = true;
+      break;
+    }
   }
+  // NOTE: stop searching before the parking check, 
+  // so the work skipped to unpark for this searcher can't be missed
+  --numSearching_;
 
-  TaskQueuePtr taskQueue;
-  if (!globalQueue_.empty())
+  if (stolen)
   {
-    taskQueue = globalQueue_.front();
-    taskQueue->setProcessing(true);
+    LOG_TRACE << "Worker " << worker->index 
+              << " stole task queue[" << taskQueue->id() << "]";
+    worker->steals.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (taskQueue) return taskQueue;
+
+  park(worker);
+  return nullptr;
+}
 
-    LOG_TRACE << "Take task queue[" << taskQueue->id() << "] from global queue";
-    taskQueue->setInGlobal(false);
-    globalQueue_.pop_front();
+TaskQueue* ThreadPool::takeFromInbox(Worker *worker)
+{
+  if (worker->inboxSize == 0) return nullptr;
+  {
+    muduo::MutexLockGuard lock(worker->inboxMutex);
+    worker->inbox.swap(worker->inboxSwapped);
+    worker->inboxSize = 0;
+  }
+  for (auto queue : worker->inboxSwapped)
+  {
+    worker->readyQueues.push(queue);
   }
+  worker->inboxSwapped.clear();
+  return takeFromReadyQueues(worker);
+}
+
+// NOTE: take the oldest one like the thieves, not pop the newest,
+// so the queue rescheduled after its drain budget doesn't starve the others
+TaskQueue* ThreadPool::takeFromReadyQueues(Worker *worker)
+{
+  TaskQueue *taskQueue = nullptr;
+  do
+  {
+    taskQueue = worker->readyQueues.steal();
+  } while (!taskQueue && !worker->readyQueues.empty());
   return taskQueue;
 }
 
-void ThreadPool::put( const TaskQueuePtr &taskQueue )
+TaskQueue* ThreadPool::steal(Worker *thief)
 {
-  muduo::MutexLockGuard lock(mutex_);
-  if (taskQueue->isProcessing() ||
-      taskQueue->isInGlobal() || 
-      taskQueue->empty())
+  size_t numWorkers = workers_.size();
+  size_t start = thief->nextRandom() % numWorkers;
+  for (size_t i = 0; i < numWorkers; ++i)
   {
-    return;
+    Worker &victim = workers_[(start + i) % numWorkers];
+    if (&victim == thief) continue;
+    TaskQueue *taskQueue = victim.readyQueues.steal();
+    if (taskQueue) return taskQueue;
+  }
+  // the queues not yet moved to the deques of the busy workers
+  for (size_t i = 0; i < numWorkers; ++i)
+  {
+    Worker &victim = workers_[(start + i) % numWorkers];
+    if (&victim == thief || victim.inboxSize == 0) continue;
+    muduo::MutexLockGuard lock(victim.inboxMutex);
+    if (!victim.inbox.empty())
+    {
+      TaskQueue *taskQueue = victim.inbox.back();
+      victim.inbox.pop_back();
+      victim.inboxSize = victim.inbox.size();
+      return taskQueue;
+    }
   }
-  LOG_TRACE << "Put task queue[" << taskQueue->id() << "] to global queue";
-  taskQueue->setInGlobal(true);
-  globalQueue_.push_back(taskQueue);
-  notEmpty_.notify();
+  return nullptr;
 }
 
-} // namespace bfcp
+void ThreadPool::runTasks(Worker *worker, TaskQueue *taskQueue)
+{
+  // run a batch to amortize the scheduling,
+  // the budget keeps the other queues from starving
+  bool hasTimeBudget = drainTime_ >= 0.0;
+  muduo::Timestamp deadline;
+  if (hasTimeBudget)
+  {
+    deadline = muduo::addTime(muduo::Timestamp::now(), drainTime_);
+  }
+  size_t numTasks = 0;
+  Task task;
+  while (numTasks < drainTasks_ && taskQueue->take(&task))
+  {
+    task();
+    ++numTasks;
+    if (hasTimeBudget && deadline < muduo::Timestamp::now()) break;
+  }
+  task.clear(); // release the bound arguments of the last one
+
+  // NOTE: take the holder before unscheduling, 
+  // the queue may be scheduled again by others right after that
+  TaskQueuePtr holder = taskQueue->releaseScheduledHolder();
+  taskQueue->unschedule();
+  // NOTE: always reschedule if not empty, the producer counted
+  // may have failed to schedule it while it was still scheduled.
+  // Nothing taken means an earlier push is still linking its node,
+  // yield and retry it after the other ready queues
+  if (!taskQueue->empty() && taskQueue->trySchedule())
+  {
+    if (numTasks == 0)
+    {
+      std::this_thread::yield();
+    }
+    taskQueue->setScheduledHolder(holder);
+    worker->readyQueues.push(taskQueue);
+    if (numParked_ > 0)
+    {
+      unparkOne(worker->index + 1);
+    }
+  }
+}
+
+void ThreadPool::schedule(const TaskQueuePtr &taskQueue)
+{
+  if (!taskQueue->trySchedule()) return;
+
+  taskQueue->setScheduledHolder(taskQueue);
+  size_t index = static_cast<size_t>(taskQueue->id()) % workers_.size();
+  Worker &worker = workers_[index];
+  {
+    muduo::MutexLockGuard lock(worker.inboxMutex);
+    worker.inbox.push_back(taskQueue.get());
+    worker.inboxSize = worker.inbox.size();
+  }
+  unparkOne(index);
+}
+
+bool ThreadPool::hasWork()
+{
+  for (auto &worker : workers_)
+  {
+    if (!worker.readyQueues.empty() || worker.inboxSize > 0) return true;
+  }
+  return false;
+}
+
+void ThreadPool::park(Worker *worker)
+{
+  worker->isParked = true;
+  ++numParked_;
+  // NOTE: check again after counted as parked, 
+  // the work scheduled before that can't be missed
+  if (hasWork() || !running_)
+  {
+    if (worker->isParked.exchange(false))
+    {
+      --numParked_;
+      return;
+    }
+    // claimed by unparkOne, wait for its notification
+  }
+  else
+  {
+    worker->parks.fetch_add(1, std::memory_order_relaxed);
+  }
 
+  muduo::MutexLockGuard lock(worker->parkMutex);
+  while (!worker->isNotified)
+  {
+    worker->unparked.wait();
+  }
+  worker->isNotified = false;
+}
+
+void ThreadPool::unparkOne(size_t preferred)
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  // a searching worker will find the work
+  if (numParked_ == 0 || numSearching_ > 0) return;
+
+  size_t numWorkers = workers_.size();
+  for (size_t i = 0; i < numWorkers; ++i)
+  {
+    Worker &worker = workers_[(preferred + i) % numWorkers];
+    if (worker.isParked.exchange(false))
+    {
+      --numParked_;
+      worker.unparks.fetch_add(1, std::memory_order_relaxed);
+      muduo::MutexLockGuard lock(worker.parkMutex);
+      worker.isNotified = true;
+      worker.unparked.notify();
+      return;
+    }
+  }
+}
+
+void ThreadPool::unparkAll()
+{
+  for (auto &worker : workers_)
+  {
+    if (worker.isParked.exchange(false))
+    {
+      --numParked_;
+      muduo::MutexLockGuard lock(worker.parkMutex);
+      worker.isNotified = true;
+      worker.unparked.notify();
+    }
+  }
+}
+
+void ThreadPool::clearScheduledQueues()
+{
+  // drop the holders of the queues still scheduled
+  for (auto &worker : workers_)
+  {
+    while (TaskQueue *taskQueue = worker.readyQueues.pop())
+    {
+      TaskQueuePtr holder = taskQueue->releaseScheduledHolder();
+      taskQueue->unschedule();
+    }
+    for (auto taskQueue : worker.inbox)
+    {
+      TaskQueuePtr holder = taskQueue->releaseScheduledHolder();
+      taskQueue->unschedule();
+    }
+    worker.inbox.clear();
+  }
+}
+
+} // namespace bfcp
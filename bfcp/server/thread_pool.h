@@ -1,8 +1,8 @@
 #ifndef BFCP_THREAD_POOL_H
 #define BFCP_THREAD_POOL_H
 
+#include <atomic>
 #include <map>
-#include <deque>
 
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
@@ -10,10 +10,10 @@
 
 #include <muduo/base/Types.h>
 #include <muduo/base/Mutex.h>
-#include <muduo/base/Condition.h>
 #include <muduo/base/Thread.h>
 
 #include <bfcp/common/bfcp_param.h>
+#include <bfcp/server/task.h>
 
 namespace bfcp
 {
@@ -21,10 +21,18 @@ namespace bfcp
 class TaskQueue;
 typedef boost::shared_ptr<TaskQueue> TaskQueuePtr;
 
+// Work-stealing pool running the task queues.
+// Each worker has a lock-free deque of the ready task queues, 
+// the queues scheduled outside the pool go to the inbox of the worker
+// chosen by the queue ID. An idle worker steals from the others
+// and parks when there is nothing to steal.
+// A task queue is scheduled to one worker at a time, 
+// so the tasks of a queue never run concurrently.
 class ThreadPool : boost::noncopyable
 {
 public:
-  typedef boost::function<void ()> Task;
+  typedef bfcp::Task Task;
+  typedef boost::function<void ()> ThreadInitCallback;
 
   enum Priority
   {
@@ -32,44 +40,92 @@ public:
     kHighPriority = 2,
   };
 
+  // the errors returned by run
+  enum
+  {
+    kQueueNotFound = -1,
+    kQueueFull = -2, // only for the normal priority tasks
+  };
+
+  typedef struct Stats
+  {
+    Stats() : steals(0), parks(0), unparks(0) {}
+
+    uint64_t steals;  // task queues taken from the other workers
+    uint64_t parks;   // workers going to sleep for no work
+    uint64_t unparks; // parked workers waken up for new work
+  } Stats;
+
 public:
   explicit ThreadPool(const string &name = string("ThreadPool"));
   ~ThreadPool(); 
 
+  static const size_t kDefaultDrainTasks = 16;
+
   // WARN: the following methods are not thread safe
   
-  void setThreadInitCallback(const Task &cb)
+  // the tasks of a queue run by a worker before turning to the other queues,
+  // at most maxTasks tasks or maxTimeInSec seconds (when < 0.0, unlimited),
+  // at least one task is run
+  void setDrainBudget(size_t maxTasks, double maxTimeInSec)
+  {
+    drainTasks_ = maxTasks > 0 ? maxTasks : 1;
+    drainTime_ = maxTimeInSec;
+  }
+
+  void setThreadInitCallback(const ThreadInitCallback &cb)
   { threadInitCallback_ = cb; }
-  void setThreadInitCallback(Task &&cb)
+  void setThreadInitCallback(ThreadInitCallback &&cb)
   { threadInitCallback_ = std::move(cb); }
   
-  int createQueue(uint32_t queueID, size_t maxQueueSize);
-  int releaseQueue(uint32_t queueID);
-  
   void start(int numThreads);
   void stop();
+
+  // NOTE: the following methods are thread safe, 
+  // they can be called by several connection loops
   
-  int run(uint32_t queueID, const Task &task, Priority priority);
+  int createQueue(uint32_t queueID, size_t maxQueueSize);
+  int releaseQueue(uint32_t queueID);
+  
+  // NOTE: never blocks, the task is dropped if the queue is full
   int run(uint32_t queueID, Task &&task, Priority priority);
 
+  Stats getStats() const;
+
 private:
-  void runInThread();
-  TaskQueuePtr take();
-  void put(const TaskQueuePtr &taskQueue);
+  struct Worker;
+
+  void runInThread(Worker *worker);
+  TaskQueue* take(Worker *worker);
+  TaskQueue* takeFromInbox(Worker *worker);
+  TaskQueue* takeFromReadyQueues(Worker *worker);
+  TaskQueue* steal(Worker *thief);
+  void runTasks(Worker *worker, TaskQueue *taskQueue);
+  void schedule(const TaskQueuePtr &taskQueue);
+  bool hasWork();
+  void park(Worker *worker);
+  void unparkOne(size_t preferred);
+  void unparkAll();
+  void clearScheduledQueues();
+  TaskQueuePtr findQueue(uint32_t queueID) const;
 
-  muduo::MutexLock mutex_;
-  muduo::Condition notEmpty_;
   string name_;
-  Task threadInitCallback_;
+  ThreadInitCallback threadInitCallback_;
+  size_t drainTasks_;
+  double drainTime_;
   
+  boost::ptr_vector<Worker> workers_;
   boost::ptr_vector<muduo::Thread> threads_;
+  mutable muduo::MutexLock queueMapMutex_; // guard queueMap_ and nextQueueID_
   std::map<uint32_t, TaskQueuePtr> queueMap_;
-  std::deque<TaskQueuePtr> globalQueue_;
+  int nextQueueID_;
+  std::atomic<int> numParked_;
+  std::atomic<int> numSearching_; // workers stealing
   
-  bool running_;
+  std::atomic<bool> running_;
 };
 
 
 } // namespace bfcp
 
-#endif // BFCP_THREAD_POOL_H
\ No newline at end of file
+#endif // BFCP_THREAD_POOL_H
@@ -1,14 +1,14 @@
 #ifndef BFCP_USER_H
 #define BFCP_USER_H
 
-#include <map>
-#include <list>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/function.hpp>
 #include <muduo/base/Timestamp.h>
 #include <muduo/net/InetAddress.h>
 #include <bfcp/common/bfcp_param.h>
+#include <bfcp/common/bfcp_flat_map.h>
+#include <bfcp/common/bfcp_id_set.h>
+#include <bfcp/server/notification_queue.h>
 
 namespace bfcp
 {
@@ -16,7 +16,7 @@ namespace bfcp
 class User : boost::noncopyable
 {
 public:
-  typedef boost::function<void ()> SendMessageTask;
+  typedef NotificationQueue::SendMessageTask SendMessageTask;
 
   User(uint16_t userID, const string &displayName, const string &uri)
       : userID_(userID),
@@ -50,6 +50,12 @@ public:
   void resetRequestCountOfFloor(uint16_t floorID);
   void clearAllRequestCount() { floorRequestCounter_.clear(); }
 
+  // the floors whose status the user queries
+  void addQueryFloor(uint16_t floorID) { queryFloors_.insert(floorID); }
+  void removeQueryFloor(uint16_t floorID) { queryFloors_.erase(floorID); }
+  void clearQueryFloors() { queryFloors_.clear(); }
+  const IdSet& getQueryFloors() const { return queryFloors_; }
+
   UserInfoParam toUserInfoParam() const 
   {
     UserInfoParam param;
@@ -59,53 +65,57 @@ public:
     return param;
   }
 
-  void runSendMessageTask(SendMessageTask &&task)
-  {
-    if (tasks_.empty())
-    {
-      task();
-    }
-    tasks_.emplace_back(std::move(task));
-  }
+  // a newer notification about the same floor or floor request
+  // replaces the queued one
+  void runSendMessageTask(NotificationQueue::Type type, 
+                          uint16_t id, 
+                          const SendMessageTask &task)
+  { notifications_.push(type, id, task); }
 
-  void runSendMessageTask(const SendMessageTask &task)
-  {
-    if (tasks_.empty())
-    {
-      task();
-    }
-    tasks_.emplace_back(task);
-  }
+  bool hasRoomForSendMessageTask(NotificationQueue::Type type, uint16_t id) const
+  { return notifications_.hasRoomFor(type, id); }
+
+  // the in-flight ones are kept
+  void clearQueuedSendMessageTasks()
+  { notifications_.clearQueued(); }
 
   void clearAllSendMessageTasks()
-  { tasks_.clear(); }
+  { notifications_.clear(); }
 
-  void runNextSendMessageTask()
-  {
-    if (!tasks_.empty())
-    {
-      tasks_.pop_front();
-      if (tasks_.empty()) return;
-      tasks_.front()();
-    }
-  }
+  void onSendMessageTaskAcked(uint32_t notificationID)
+  { notifications_.onAcked(notificationID); }
+
+  // return false if the notification is no longer in flight
+  bool onSendMessageTaskFailed(uint32_t notificationID)
+  { return notifications_.onFailed(notificationID); }
+
+  void setNotificationWindow(size_t window)
+  { notifications_.setWindow(window); }
+
+  size_t getNotificationQueueDepth() const
+  { return notifications_.depth(); }
+  size_t getNotificationsInFlight() const
+  { return notifications_.inFlight(); }
+  const NotificationQueue::Stats& getNotificationQueueStats() const
+  { return notifications_.getStats(); }
 
 private:
   // key: floor ID, value: request count
-  typedef std::map<uint16_t, uint16_t> FloorRequestMap;
+  typedef FlatMap<uint16_t, uint16_t> FloorRequestMap;
 
   uint16_t userID_;
   string displayName_;
   string uri_;
   muduo::net::InetAddress addr_;
   FloorRequestMap floorRequestCounter_;
-  std::list<SendMessageTask> tasks_;
+  IdSet queryFloors_;
+  NotificationQueue notifications_;
   bool isAvailable_;
   muduo::Timestamp activeTime_;
 };
 
 typedef boost::shared_ptr<User> UserPtr;
-typedef std::map<uint16_t, UserPtr> UserDict;
+typedef FlatMap<uint16_t, UserPtr> UserDict;
 
 } // namespace bfcp
 
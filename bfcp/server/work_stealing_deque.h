@@ -0,0 +1,155 @@
+#ifndef BFCP_WORK_STEALING_DEQUE_H
+#define BFCP_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <stdint.h>
+
+namespace bfcp
+{
+
+// Chase-Lev work-stealing deque of pointers,
+// with the memory orders of "Correct and Efficient Work-Stealing for 
+// Weak Memory Models" (Le et al. 2013).
+// The owner thread pushes and pops at the bottom without locking,
+// the other threads steal from the top with one CAS.
+// The buffer grows when it's full, the old buffers are only freed
+// by the destructor since a thief may still read them.
+// NOTE: push and pop must be called by the owner thread only.
+template <typename T>
+class WorkStealingDeque : boost::noncopyable
+{
+public:
+  static const size_t kDefaultCapacity = 64;
+
+  explicit WorkStealingDeque(size_t capacity = kDefaultCapacity)
+      : top_(0), bottom_(0)
+  {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    Buffer *buffer = new Buffer(capacity);
+    buffers_.push_back(buffer);
+    buffer_.store(buffer, std::memory_order_relaxed);
+  }
+
+  ~WorkStealingDeque()
+  {
+    for (auto buffer : buffers_)
+    {
+      delete buffer;
+    }
+  }
+
+  void push(T *value)
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Buffer *buffer = buffer_.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(buffer->capacity) - 1)
+    {
+      buffer = grow(buffer, t, b);
+    }
+    buffer->put(b, value);
+    // NOTE: the release store instead of the release fence,
+    // it's the same on x86 and visible to the race detectors
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // return nullptr if empty
+  T* pop()
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer *buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b)
+    {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T *value = buffer->get(b);
+    if (t == b)
+    {
+      // the last one, race with the thieves
+      if (!top_.compare_exchange_strong(t, t + 1, 
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+      {
+        value = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return value;
+  }
+
+  // return nullptr if empty or lost the race with others
+  T* steal()
+  {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    Buffer *buffer = buffer_.load(std::memory_order_acquire);
+    T *value = buffer->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, 
+          std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+      return nullptr;
+    }
+    return value;
+  }
+
+  // only a hint when called by the thieves
+  bool empty() const
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b <= t;
+  }
+
+private:
+  struct Buffer : boost::noncopyable
+  {
+    explicit Buffer(size_t cap)
+        : capacity(cap), mask(cap - 1), slots(new std::atomic<T*>[cap])
+    {}
+
+    ~Buffer() { delete[] slots; }
+
+    T* get(int64_t i) const
+    { return slots[i & mask].load(std::memory_order_relaxed); }
+    void put(int64_t i, T *value)
+    { slots[i & mask].store(value, std::memory_order_relaxed); }
+
+    const size_t capacity;
+    const size_t mask;
+    std::atomic<T*> *slots;
+  };
+
+  Buffer* grow(Buffer *buffer, int64_t t, int64_t b)
+  {
+    Buffer *bigger = new Buffer(buffer->capacity * 2);
+    for (int64_t i = t; i != b; ++i)
+    {
+      bigger->put(i, buffer->get(i));
+    }
+    buffers_.push_back(bigger);
+    buffer_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Buffer*> buffer_;
+  std::vector<Buffer*> buffers_; // owned by the owner thread
+};
+
+} // namespace bfcp
+
+#endif // BFCP_WORK_STEALING_DEQUE_H
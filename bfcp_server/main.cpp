@@ -92,6 +92,7 @@ void printMenu()
     " m      - modify the conference\n"
     " s      - Show the conferences in the BFCP server\n"
     " e      - Get all conference IDs in FCS\n"
+    " t      - Show the worker thread stats\n"
     " q      - Quit\n"
     " p      - Preset Conference\n"
     "--------------------------------------------------------------\n\n");
@@ -116,10 +117,27 @@ void controlFunc(BaseServer *server)
         {
           server->enableConnectionThread();
         }
+        printf("Enter the connection loop num\n\t(> 1 for receiving with SO_REUSEPORT sockets):\n");
+        int connectionLoopNum = 1;
+        CHECK_CIN_RESULT(std::cin >> connectionLoopNum);
+        server->setConnectionLoopNum(connectionLoopNum);
+        printf("Run conference tasks in the connection loops: 0 = disable, 1 = enable\n");
+        bool enableConferenceAffinity = false;
+        CHECK_CIN_RESULT(std::cin >> enableConferenceAffinity);
+        if (enableConferenceAffinity)
+        {
+          server->enableConferenceAffinity();
+        }
         printf("Enter the worker thread num:\n");
         int threadNum = 0;
         CHECK_CIN_RESULT(std::cin >> threadNum);
         server->setWorkerThreadNum(threadNum);
+        printf("Enter the max tasks and the max seconds a worker thread spends on a conference\n"
+               "\t(seconds < 0 for no time limit):\n");
+        size_t drainTasks = ThreadPool::kDefaultDrainTasks;
+        double drainTime = -1.0;
+        CHECK_CIN_RESULT(std::cin >> drainTasks >> drainTime);
+        server->setTaskDrainBudget(drainTasks, drainTime);
         printf("Enter the user obsoleted time:\n");
         double userObsoletedTime = 0.0;
         CHECK_CIN_RESULT(std::cin >> userObsoletedTime);
@@ -269,6 +287,14 @@ void controlFunc(BaseServer *server)
       {
         server->getConferenceIDs(&handleGetConferenceIDsResult);
       } break;
+    case 't':
+      {
+        ThreadPool::Stats stats = server->getWorkerThreadStats();
+        printf("Worker thread stats: steals = %llu, parks = %llu, unparks = %llu\n",
+               static_cast<unsigned long long>(stats.steals),
+               static_cast<unsigned long long>(stats.parks),
+               static_cast<unsigned long long>(stats.unparks));
+      } break;
     case 'q':
       printf("Quit\n");
       server->stop();